@@ -0,0 +1,210 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <array>
+#include <math.h>
+#include <string.h>
+#include "kernels.hpp"
+
+// Air absorption of FILTERS sound paths, one biquad per path. The filters
+// are stored as structure of arrays and run in banks of the biquad lanes of
+// the kernels, one per float of a vector: the recursion of a biquad cannot be
+// vectorized over time, but the same step of neighbouring filters can. The
+// signals of a bank are interleaved into a local buffer, filtered by
+// biquads() (kernels.hpp) and written back in place.
+//
+// Air damps high frequencies by about ABSORPTION dB per m at 10 kHz, rising
+// with the square of the frequency (ISO 9613-1, 20 degrees C, 50% humidity).
+// Two real poles at the same cutoff fall off with the square of the
+// frequency as well below the cutoff, the filter of a path is such a pair,
+// placed so that both agree. It passes DC unchanged.
+//
+// setDistance() sets the target coefficients of a path, startRamp() ramps
+// the coefficients of all paths from where they are to the targets over a
+// given number of frames. The ramp goes on across calls of process(), which
+// the owner moves on with advance(), so the response at every frame does not
+// depend on how the blocks are split. The stable coefficients of a biquad
+// form a convex set, so every coefficient on the ramp is stable too.
+template <int FILTERS>
+class AirAbsorption {
+public:
+	void init(double sampleRate, const Kernels& kernels) {
+		this->kernels = &kernels;
+		rate = sampleRate;
+		for (int k = 0; k < FILTERS; k++) {
+			target[B0][k] = 1.f;
+			for (int c = B1; c < COEFFICIENTS; c++) target[c][k] = 0.f;
+		}
+		clean();
+	}
+
+	// Silence all paths and apply the target coefficients at once
+	void clean() {
+		current = target;
+		rampPosition = rampLength = 0;
+		z1.fill(0.f);
+		z2.fill(0.f);
+	}
+
+	// Filter of path k for a path of distance m, reached by the next ramp
+	void setDistance(int k, double distance) {
+		// 2 poles of 10 log10(1 + (f / fc)^2) dB each
+		double dbPerM = ABSORPTION / (1e4 * 1e4);
+		double cutoff = sqrt(2.0 * 10.0 / log(10.0) / (dbPerM * fmax(distance, MIN_DISTANCE)));
+		double p = exp(-2.0 * M_PI * cutoff / rate);
+		target[B0][k] = (1.0 - p) * (1.0 - p);
+		target[B1][k] = 0.f;
+		target[B2][k] = 0.f;
+		target[A1][k] = -2.0 * p;
+		target[A2][k] = p * p;
+	}
+
+	// Ramp the coefficients of all paths from where they are to the targets
+	// over the next frames frames
+	void startRamp(int frames) {
+		for (int c = 0; c < COEFFICIENTS; c++) {
+			for (int k = 0; k < FILTERS; k++) {
+				current[c][k] = coefficient(c, k);
+				step[c][k] = (target[c][k] - current[c][k]) / frames;
+			}
+		}
+		rampPosition = 0;
+		rampLength = frames;
+	}
+
+	// Move the ramp on by the n frames the last process() calls filtered
+	void advance(int n) {
+		if (!rampLength) return;
+		rampPosition += n;
+		if (rampPosition < rampLength) return;
+		current = target;
+		rampPosition = rampLength = 0;
+	}
+
+	// Whether the filter of path k still rings out after its input fell
+	// silent. The state decays to 0, denormals are flushed.
+	bool ringing(int k) const {
+		return z1[k] != 0.f || z2[k] != 0.f;
+	}
+
+	// Whether any path still rings out
+	bool ringing() const {
+		for (int k = 0; k < FILTERS; k++) {
+			if (ringing(k)) return true;
+		}
+		return false;
+	}
+
+	// Filter the n frames of the paths [first, last[ in place, signal[i] is
+	// path first + i. Calls for disjoint ranges may run in parallel.
+	void process(float* const* signal, int first, int last, int n) {
+		const int lanes = kernels->biquadLanes;
+		for (int bank = first / lanes * lanes; bank < last; bank += lanes) {
+			int lo = (first > bank) ? first : bank;
+			int hi = (last < bank + lanes) ? last : bank + lanes;
+			if (lanes == 16) processBank<16>(signal + (lo - first), bank, lo, hi, n);
+			else processBank<8>(signal + (lo - first), bank, lo, hi, n);
+		}
+	}
+
+private:
+	// In the order of biquads()
+	enum Coefficient {
+		B0,
+		B1,
+		B2,
+		A1,
+		A2,
+		COEFFICIENTS
+	};
+
+	// dB per m at 10 kHz
+	static constexpr double ABSORPTION = 0.15;
+	// Closer paths get the filter of this distance, its cutoff is far
+	// above any sample rate
+	static constexpr double MIN_DISTANCE = 0.1;
+	// Frames interleaved at a time
+	static const int CHUNK = 64;
+
+	// Coefficient c of path k at the current position of the ramp
+	float coefficient(int c, int k) const {
+		return rampLength ? current[c][k] + rampPosition * step[c][k] : current[c][k];
+	}
+
+	// The paths [lo, hi[ of the bank starting at path bank, LANES is the
+	// biquadLanes of the kernels (8 or 16). Only the owned paths are read
+	// and written, the other lanes filter silence. The frames up to the end
+	// of the ramp are filtered with ramping coefficients, the rest with the
+	// targets.
+	template <int LANES>
+	void processBank(float* const* signal, int bank, int lo, int hi, int n) {
+		const int lanes = LANES;
+		alignas(64) float coefficients[COEFFICIENTS * LANES] = { };
+		alignas(64) float steps[COEFFICIENTS * LANES] = { };
+		alignas(64) float state[2 * LANES] = { };
+		alignas(64) float buffer[CHUNK * LANES];
+		bool ramp = false;
+		for (int k = lo; k < hi; k++) {
+			for (int c = 0; c < COEFFICIENTS; c++) {
+				coefficients[c * lanes + k - bank] = coefficient(c, k);
+				if (rampLength) steps[c * lanes + k - bank] = step[c][k];
+				ramp = ramp || (rampLength && step[c][k] != 0.f);
+			}
+			state[k - bank] = z1[k];
+			state[lanes + k - bank] = z2[k];
+		}
+		// Frames until the end of the ramp
+		int left = ramp ? rampLength - rampPosition : 0;
+
+		for (int start = 0; start < n; start += CHUNK) {
+			int frames = (n - start < CHUNK) ? n - start : CHUNK;
+			if (hi - lo < lanes) memset(buffer, 0, frames * lanes * sizeof(float));
+			for (int k = lo; k < hi; k++) {
+				const float* in = signal[k - lo] + start;
+				for (int f = 0; f < frames; f++) buffer[f * lanes + k - bank] = in[f];
+			}
+			int ramped = (left - start < 0) ? 0 : (left - start < frames) ? left - start : frames;
+			if (ramped) {
+				kernels->biquads[true](buffer, ramped, coefficients, steps, state);
+				if (start + ramped == left) {
+					for (int k = lo; k < hi; k++) {
+						for (int c = 0; c < COEFFICIENTS; c++) coefficients[c * lanes + k - bank] = target[c][k];
+					}
+				}
+			}
+			if (ramped < frames) kernels->biquads[false](buffer + ramped * lanes, frames - ramped, coefficients, steps, state);
+			for (int k = lo; k < hi; k++) {
+				float* out = signal[k - lo] + start;
+				for (int f = 0; f < frames; f++) out[f] = buffer[f * lanes + k - bank];
+			}
+		}
+
+		for (int k = lo; k < hi; k++) {
+			z1[k] = state[k - bank];
+			z2[k] = state[lanes + k - bank];
+		}
+	}
+
+	const Kernels* kernels = nullptr;
+	double rate;
+	// Coefficients at the start of the ramp and their increments per frame
+	std::array<std::array<float, FILTERS>, COEFFICIENTS> current, step, target;
+	int rampPosition, rampLength;
+	std::array<float, FILTERS> z1, z2;
+};
@@ -0,0 +1,86 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// One allocation for all buffers of an instance. The owner adds up the
+// bytes() of its buffers, allocates once and take()s the buffers, each of
+// which starts on its own cache line. allocate() zeroes the whole arena,
+// which also maps all its pages before the audio thread touches them. Built
+// with -DPAN_MLOCK the pages are locked in memory as well, where the memlock
+// limit allows it.
+class Arena {
+public:
+	static const size_t ALIGN = 64;
+
+	Arena() = default;
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	~Arena() {
+		release();
+	}
+
+	// Bytes taken by count objects of T
+	template <typename T>
+	static size_t bytes(size_t count) {
+		return (count * sizeof(T) + ALIGN - 1) / ALIGN * ALIGN;
+	}
+
+	void allocate(size_t bytes) {
+		release();
+		// Fails like new
+		if (posix_memalign((void**) &memory, ALIGN, bytes ? bytes : ALIGN) != 0) throw std::bad_alloc();
+		size = bytes;
+		used = 0;
+		memset(memory, 0, size);
+#ifdef PAN_MLOCK
+		locked = (mlock(memory, size) == 0);
+#endif
+	}
+
+	// The next count objects of T, zeroed. T must be trivial.
+	template <typename T>
+	T* take(size_t count) {
+		T* buffer = (T*) (memory + used);
+		used += bytes<T>(count);
+		return buffer;
+	}
+
+	size_t getSize() const {
+		return size;
+	}
+
+private:
+	void release() {
+		if (locked) munlock(memory, size);
+		free(memory);
+		memory = nullptr;
+		size = used = 0;
+		locked = false;
+	}
+
+	char* memory = nullptr;
+	size_t size = 0;
+	size_t used = 0;
+	bool locked = false;
+};
@@ -0,0 +1,258 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// Host-free benchmark: runs Pan::runBase() over synthetic input and sweeps
+// channel count, sample rate, block size, window size and output path.
+//
+// Usage: pan-bench [-c channels] [-r rate] [-b block] [-m static|smooth|fade]
+//                  [-w window] [-i interpolation] [-u blocks] [-s seconds]
+//                  [-a active] [-l listeners] [-f binaural] [-e reflections]
+//                  [-A air] [-o format] [-F fixed] [-k kernels]
+//
+// -c, -r, -b, -m, -w, -i and -l may be given several times and restrict the
+// sweep to the given values. In smooth and fade mode a parameter is changed
+// every -u blocks (default 1), so the instance never leaves the smoothing
+// path, which glides in smooth mode and crossfades in fade mode.
+// Every configuration processes -s seconds of audio (default 1). With -a
+// only the first active inputs carry noise, all others are silent. With
+// -l 3 the variants with three listeners are measured, the cost per channel
+// is then per channel and listener. -f 1 turns on the binaural head filters,
+// -e 1 the early reflections of the default room, -A 1 the air absorption.
+// -o 1, 2 or 3 encodes the center listener to first or third order
+// Ambisonics or to a ring of 8 speakers. Every instance is told that the
+// host runs fixed blocks of -b frames, -F 0 leaves the block length unknown,
+// like a host without the buf-size extension. -k avx512, avx2 or the kernels
+// of the compiler target (e.g. sse2) replace the kernels dispatch.hpp picks
+// for the CPU.
+
+#include "pan.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+template <int N, int L>
+class BenchPan : public Pan<N, L> {
+public:
+	BenchPan(int srate, int block, bool fixed, const Kernels& kernels) {
+		this->sample_rate = srate;
+		this->kernels = &kernels;
+		if (fixed) {
+			this->blockLengths.minimum = this->blockLengths.nominal = this->blockLengths.maximum = block;
+			this->blockLengths.fixed = true;
+			this->blockLengths.powerOf2 = (block & (block - 1)) == 0;
+		}
+		this->init(srate);
+	}
+
+	bool smoothing() const {
+		return this->useAverage;
+	}
+};
+
+struct Settings {
+	std::vector<int> channels { 2, 4, 5, 8, 9, 12, 16, 24, 32, 64, 128 };
+	std::vector<int> listeners { 1 };
+	std::vector<int> rates { 44100, 48000, 96000, 192000 };
+	std::vector<int> blocks { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
+	// 0 static, 1 smooth, 2 fade
+	std::vector<int> smooth { 0, 1, 2 };
+	std::vector<float> windows { 1.0 };
+	std::vector<int> interpolations { INTERPOLATION_LINEAR };
+	int updateEvery = 1;
+	int active = -1;
+	bool binaural = false;
+	bool reflections = false;
+	bool air = false;
+	int format = OUTPUT_STEREO;
+	bool fixed = true;
+	const Kernels* kernels = &chosenKernels();
+	double seconds = 1.0;
+};
+
+template <int N, int L>
+void bench(const Settings& settings, int rate, int block, int smooth, float window, int interpolation) {
+	BenchPan<N, L> pan(rate, block, settings.fixed, *settings.kernels);
+
+	// radius, player distance, ear distance, alpha 0, window, relative delays
+	float controls[6] = { 5.f, 1.f, 0.149f, 0.f, window, 0.f };
+	float interpolationControl = interpolation;
+	std::vector<float> input(N * block), output(2 * L * block), surround(Surround::OUTPUTS * block);
+
+	for (int i = 0; i < 6; i++) pan.connect_portBase(i, &controls[i]);
+	pan.connect_portBase(6, output.data());
+	pan.connect_portBase(7, output.data() + block);
+	for (int ch = 0; ch < N; ch++) pan.connect_portBase(8 + ch, input.data() + ch * block);
+	pan.connect_portBase(8 + N, &interpolationControl);
+	float delayMode = (smooth == 2) ? DELAY_CROSSFADE : DELAY_GLIDE;
+	pan.connect_portBase(18 + 3 * N, &delayMode);
+	float binaural = settings.binaural ? 1.f : 0.f;
+	pan.connect_portBase(20 + 3 * N + 5 * (L - 1), &binaural);
+	// Early reflections, room width, depth, height and absorption
+	float room[5] = { settings.reflections ? 1.f : 0.f, 12.f, 16.f, 5.f, 0.3f };
+	for (int i = 0; i < 5; i++) pan.connect_portBase(22 + 3 * N + 5 * (L - 1) + i, &room[i]);
+	float air = settings.air ? 1.f : 0.f;
+	pan.connect_portBase(27 + 3 * N + 5 * (L - 1), &air);
+	float format = settings.format;
+	pan.connect_portBase(28 + 3 * N + 5 * (L - 1), &format);
+	for (int o = 0; o < Surround::OUTPUTS; o++) pan.connect_portBase(30 + 3 * N + 5 * (L - 1) + o, surround.data() + o * block);
+	// Further listeners stand in a row behind the first one
+	std::vector<float> positions(3 * L);
+	for (int l = 1; l < L; l++) {
+		int port = 20 + 3 * N + 5 * (l - 1);
+		positions[3 * l] = (l % 2) ? l : -l;
+		positions[3 * l + 1] = -1.f;
+		pan.connect_portBase(port, output.data() + 2 * l * block);
+		pan.connect_portBase(port + 1, output.data() + (2 * l + 1) * block);
+		for (int i = 0; i < 3; i++) pan.connect_portBase(port + 2 + i, &positions[3 * l + i]);
+	}
+
+	// Deterministic white noise
+	uint32_t seed = 1;
+	for (float& x : input) {
+		seed = seed * 1664525 + 1013904223;
+		x = (seed >> 8) / 8388608.f - 1.f;
+	}
+	if (settings.active >= 0 && settings.active < N) {
+		std::fill(input.begin() + settings.active * block, input.end(), 0.f);
+	}
+
+	pan.activateBase();
+
+	// The static path is only taken after the smoother has settled
+	if (!smooth) {
+		for (long frames = 0; pan.smoothing() && frames < 10L * rate; frames += block) {
+			pan.runBase(block);
+		}
+	}
+
+	long blocks = settings.seconds * rate / block;
+	if (blocks < 1) blocks = 1;
+
+	double total = 0.0, worst = 0.0;
+	for (long b = 0; b < blocks; b++) {
+		if (smooth && b % settings.updateEvery == 0) controls[3] = (controls[3] == 0.f) ? 0.5f : 0.f;
+
+		auto start = std::chrono::steady_clock::now();
+		pan.runBase(block);
+		auto stop = std::chrono::steady_clock::now();
+
+		double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+		total += ns;
+		if (ns > worst) worst = ns;
+	}
+
+	double nsPerFrame = total / (blocks * block);
+	double deadline = 1e9 * block / rate;
+	printf("%4d %3d %7d %6d %-6s %6.2f %4d %10.2f %12.3f %12.2f %8.2f\n",
+		N, L, rate, block, smooth == 2 ? "fade" : smooth ? "smooth" : "static", window, interpolation,
+		nsPerFrame, nsPerFrame / (N * L), worst / 1000.0, 100.0 * worst / deadline);
+}
+
+template <int N, int L = 1>
+void sweep(const Settings& settings) {
+	for (int rate : settings.rates)
+		for (int block : settings.blocks)
+			for (int smooth : settings.smooth)
+				for (float window : settings.windows)
+					for (int interpolation : settings.interpolations)
+						bench<N, L>(settings, rate, block, smooth, window, interpolation);
+}
+
+// Run the sweep for all variants also exported by the plugin
+void run(const Settings& settings, int channels, int listeners) {
+	if (listeners != 1) {
+		if (channels == 9 && listeners == 3) sweep<9, 3>(settings);
+		else if (channels == 16 && listeners == 3) sweep<16, 3>(settings);
+		else fprintf(stderr, "No plugin with %d channels and %d listeners\n", channels, listeners);
+		return;
+	}
+	switch (channels) {
+	case 2: sweep<2>(settings); break;
+	case 4: sweep<4>(settings); break;
+	case 5: sweep<5>(settings); break;
+	case 8: sweep<8>(settings); break;
+	case 9: sweep<9>(settings); break;
+	case 12: sweep<12>(settings); break;
+	case 16: sweep<16>(settings); break;
+	case 24: sweep<24>(settings); break;
+	case 32: sweep<32>(settings); break;
+	case 64: sweep<64>(settings); break;
+	case 128: sweep<128>(settings); break;
+	default: fprintf(stderr, "No plugin with %d channels\n", channels);
+	}
+}
+
+int main(int argc, char** argv) {
+	Settings settings;
+	Settings given;
+	given.channels.clear();
+	given.rates.clear();
+	given.blocks.clear();
+	given.smooth.clear();
+	given.windows.clear();
+	given.interpolations.clear();
+	given.listeners.clear();
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const char* value = argv[i + 1];
+		if (!strcmp(argv[i], "-c")) given.channels.push_back(atoi(value));
+		else if (!strcmp(argv[i], "-r")) given.rates.push_back(atoi(value));
+		else if (!strcmp(argv[i], "-b")) given.blocks.push_back(atoi(value));
+		else if (!strcmp(argv[i], "-m")) given.smooth.push_back(!strcmp(value, "fade") ? 2 : !strcmp(value, "smooth"));
+		else if (!strcmp(argv[i], "-w")) given.windows.push_back(atof(value));
+		else if (!strcmp(argv[i], "-i")) given.interpolations.push_back(atoi(value));
+		else if (!strcmp(argv[i], "-u")) settings.updateEvery = atoi(value) > 0 ? atoi(value) : 1;
+		else if (!strcmp(argv[i], "-s")) settings.seconds = atof(value);
+		else if (!strcmp(argv[i], "-a")) settings.active = atoi(value);
+		else if (!strcmp(argv[i], "-l")) given.listeners.push_back(atoi(value));
+		else if (!strcmp(argv[i], "-f")) settings.binaural = atoi(value) != 0;
+		else if (!strcmp(argv[i], "-e")) settings.reflections = atoi(value) != 0;
+		else if (!strcmp(argv[i], "-A")) settings.air = atoi(value) != 0;
+		else if (!strcmp(argv[i], "-o")) settings.format = atoi(value);
+		else if (!strcmp(argv[i], "-F")) settings.fixed = atoi(value) != 0;
+		else if (!strcmp(argv[i], "-k")) {
+			settings.kernels = findKernels(value);
+			if (!settings.kernels) {
+				fprintf(stderr, "No kernels %s for this CPU\n", value);
+				return 1;
+			}
+		}
+		else {
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (!given.channels.empty()) settings.channels = given.channels;
+	if (!given.rates.empty()) settings.rates = given.rates;
+	if (!given.blocks.empty()) settings.blocks = given.blocks;
+	if (!given.smooth.empty()) settings.smooth = given.smooth;
+	if (!given.windows.empty()) settings.windows = given.windows;
+	if (!given.interpolations.empty()) settings.interpolations = given.interpolations;
+	if (!given.listeners.empty()) settings.listeners = given.listeners;
+
+	printf("Kernels: %s\n", settings.kernels->name);
+	printf("%4s %3s %7s %6s %-6s %6s %4s %10s %12s %12s %8s\n",
+		"ch", "lis", "rate", "block", "mode", "window", "int",
+		"ns/frame", "ns/frame/ch", "worst [us]", "worst %");
+	for (int channels : settings.channels)
+		for (int listeners : settings.listeners) run(settings, channels, listeners);
+
+	return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include "arena.hpp"
+
+// Uniformly partitioned overlap-save convolution. Inputs and impulse
+// responses are cut into partitions of BLOCK frames and kept as spectra of
+// SIZE = 2 * BLOCK points: every BLOCK frames an input adds the spectrum of
+// its last SIZE frames to its frequency-domain delay line, and the output
+// spectrum is the sum over all partitions k of input spectrum k blocks ago
+// times partition k of the impulse response. Products of many inputs can be
+// summed before a single inverse transform, the last BLOCK frames of it are
+// the output of the block. As the output of a block is only known once the
+// whole block is in, a stream through it is BLOCK frames late.
+// The transforms are real FFTs of SIZE points through a complex radix-2 FFT
+// of SIZE / 2 points (even samples real, odd samples imaginary).
+class Convolution {
+public:
+	static const int BLOCK = 64;
+	static const int SIZE = 2 * BLOCK;
+	static const int BINS = BLOCK + 1;
+
+	// Bins 0 to BLOCK of the transform of SIZE real points, split into real and
+	// imaginary parts so that the products vectorize
+	struct Spectrum {
+		alignas(32) float re[BINS];
+		alignas(32) float im[BINS];
+
+		void clear() {
+			memset(re, 0, sizeof(re));
+			memset(im, 0, sizeof(im));
+		}
+	};
+
+	Convolution() {
+		for (int i = 0; i < HALF; i++) {
+			int r = 0;
+			for (int bit = 1, j = i; bit < HALF; bit <<= 1, j >>= 1) r = (r << 1) | (j & 1);
+			reversed[i] = r;
+		}
+		for (int k = 0; k < BINS; k++) {
+			splitRe[k] = cos(2.0 * M_PI * k / SIZE);
+			splitIm[k] = -sin(2.0 * M_PI * k / SIZE);
+		}
+		for (int k = 0; k < HALF / 2; k++) {
+			twiddleRe[k] = cos(2.0 * M_PI * k / HALF);
+			twiddleIm[k] = -sin(2.0 * M_PI * k / HALF);
+		}
+	}
+
+	void forward(const float* in, Spectrum& out) const {
+		float zr[HALF], zi[HALF];
+		for (int n = 0; n < HALF; n++) {
+			zr[reversed[n]] = in[2 * n];
+			zi[reversed[n]] = in[2 * n + 1];
+		}
+		transform(zr, zi);
+
+		// X[k] = E[k] + W^k O[k] with the spectra E, O of the even and odd samples
+		for (int k = 0; k <= HALF; k++) {
+			int a = k % HALF;
+			int b = (HALF - k) % HALF;
+			float er = 0.5f * (zr[a] + zr[b]);
+			float ei = 0.5f * (zi[a] - zi[b]);
+			float orr = 0.5f * (zi[a] + zi[b]);
+			float oi = -0.5f * (zr[a] - zr[b]);
+			out.re[k] = er + splitRe[k] * orr - splitIm[k] * oi;
+			out.im[k] = ei + splitRe[k] * oi + splitIm[k] * orr;
+		}
+	}
+
+	// Inverse of forward(), including the scaling
+	void inverse(const Spectrum& in, float* out) const {
+		float zr[HALF], zi[HALF];
+		for (int k = 0; k < HALF; k++) {
+			int b = HALF - k;
+			// E[k] and O[k] = (X[k] - conj(X[HALF - k])) / 2 / W^k
+			float er = 0.5f * (in.re[k] + in.re[b]);
+			float ei = 0.5f * (in.im[k] - in.im[b]);
+			float dr = 0.5f * (in.re[k] - in.re[b]);
+			float di = 0.5f * (in.im[k] + in.im[b]);
+			float orr = dr * splitRe[k] + di * splitIm[k];
+			float oi = di * splitRe[k] - dr * splitIm[k];
+			// Z = E + i O, conjugated for the inverse through the forward transform
+			zr[reversed[k]] = er - oi;
+			zi[reversed[k]] = -(ei + orr);
+		}
+		transform(zr, zi);
+		float scale = 1.f / HALF;
+		for (int n = 0; n < HALF; n++) {
+			out[2 * n] = zr[n] * scale;
+			out[2 * n + 1] = -zi[n] * scale;
+		}
+	}
+
+private:
+	// In-place butterflies on bit-reversed input
+	void transform(float* re, float* im) const {
+		for (int size = 2; size <= HALF; size <<= 1) {
+			int half = size / 2;
+			int step = HALF / size;
+			for (int start = 0; start < HALF; start += size) {
+				for (int j = 0; j < half; j++) {
+					float wr = twiddleRe[j * step];
+					float wi = twiddleIm[j * step];
+					int a = start + j;
+					int b = a + half;
+					float tr = re[b] * wr - im[b] * wi;
+					float ti = re[b] * wi + im[b] * wr;
+					re[b] = re[a] - tr;
+					im[b] = im[a] - ti;
+					re[a] += tr;
+					im[a] += ti;
+				}
+			}
+		}
+	}
+
+	static const int HALF = SIZE / 2;
+
+	int reversed[HALF];
+	float splitRe[BINS], splitIm[BINS];
+	float twiddleRe[HALF / 2], twiddleIm[HALF / 2];
+
+public:
+	// Partitions of an impulse response of length taps
+	static int partitions(int length) {
+		return (length + BLOCK - 1) / BLOCK;
+	}
+
+	// Impulse response cut into partitions of BLOCK taps
+	class Filter {
+	public:
+		// Arena bytes of a filter of length taps
+		static size_t bytes(int length) {
+			return Arena::bytes<Spectrum>(Convolution::partitions(length));
+		}
+
+		void init(const Convolution& fft, const float* response, int length, Arena& arena) {
+			count = Convolution::partitions(length);
+			parts = arena.take<Spectrum>(count);
+			float padded[SIZE];
+			for (int p = 0; p < count; p++) {
+				// Overlap-save: the partition is followed by zeros
+				memset(padded, 0, sizeof(padded));
+				int taps = (length - p * BLOCK < BLOCK) ? length - p * BLOCK : BLOCK;
+				memcpy(padded, response + p * BLOCK, taps * sizeof(float));
+				fft.forward(padded, parts[p]);
+			}
+		}
+
+		int partitions() const {
+			return count;
+		}
+
+		Spectrum* parts = nullptr;
+		int count = 0;
+	};
+
+	// One input: its last SIZE frames and the spectra of its last partitions.
+	// Blocks of silence are not transformed, an input whose delay line only
+	// holds silence adds nothing.
+	class Input {
+	public:
+		// Arena bytes of an input of init(partitions)
+		static size_t bytes(int partitions) {
+			return Arena::bytes<Spectrum>(partitions) + Arena::bytes<bool>(partitions);
+		}
+
+		void init(int partitions, Arena& arena) {
+			count = partitions;
+			line = arena.take<Spectrum>(count);
+			zero = arena.take<bool>(count);
+			clean();
+		}
+
+		// The spectra of silent blocks are never read, only their flags
+		// are reset
+		void clean() {
+			memset(history, 0, sizeof(history));
+			for (int p = 0; p < count; p++) zero[p] = true;
+			newest = 0;
+			quiet = count;
+			heard = false;
+		}
+
+		// Where frame i of the current block is written
+		float* block(int i) {
+			return history + BLOCK + i;
+		}
+
+		// Take the current block, sound is false if it is all zeros
+		void push(const Convolution& fft, bool sound) {
+			newest = (newest + 1) % count;
+			// The previous block is the first half of the transform
+			zero[newest] = !sound && !heard;
+			if (!zero[newest]) fft.forward(history, line[newest]);
+			quiet = zero[newest] ? quiet + 1 : 0;
+			heard = sound;
+			memcpy(history, history + BLOCK, BLOCK * sizeof(float));
+		}
+
+		bool silent() const {
+			return quiet >= count;
+		}
+
+		// Add the spectrum of the input filtered by filter to sum
+		void filterInto(Spectrum& sum, const Filter& filter) const {
+			for (int p = 0; p < count && p < filter.partitions(); p++) {
+				int slot = (newest - p + count) % count;
+				if (zero[slot]) continue;
+				const Spectrum& x = line[slot];
+				const Spectrum& h = filter.parts[p];
+				for (int k = 0; k < BINS; k++) {
+					sum.re[k] += x.re[k] * h.re[k] - x.im[k] * h.im[k];
+					sum.im[k] += x.re[k] * h.im[k] + x.im[k] * h.re[k];
+				}
+			}
+		}
+
+	private:
+		float history[SIZE];
+		Spectrum* line = nullptr;
+		bool* zero = nullptr;
+		int count = 0;
+		int newest;
+		int quiet;
+		bool heard;
+	};
+};
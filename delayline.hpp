@@ -0,0 +1,164 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string.h>
+#include "arena.hpp"
+#include "dispatch.hpp"
+
+// Delay line for CHANNELS inputs. The channels are stored in tiles of TILE
+// channels, whose frames are interleaved: TILE = 1 stores every channel in
+// its own row, TILE = CHANNELS stores whole frames. Every tile is a ring
+// buffer of exactly the requested size, followed by a guard region that mirrors
+// the first frames of the ring. Any window of up to `guard` samples can
+// therefore be read as one span with a fixed stride of STRIDE floats, no
+// matter where in the ring it starts.
+//
+// write() also notes when each channel last wrote a non-silent sample. Once
+// a whole ring of silence has been written after it, every read of that
+// channel returns zeros and silent() is set. The storage comes from the
+// arena of the owner, which starts zeroed, and clean() only clears the
+// frames written since the last clean().
+template <int CHANNELS, int TILE = 1>
+class DelayLine {
+public:
+	static const int STRIDE = TILE;
+	static const int TILES = (CHANNELS + TILE - 1) / TILE;
+
+	// Arena bytes of a delay line of init(minSize, guardSize)
+	static size_t bytes(int minSize, int guardSize) {
+		return Arena::bytes<float>(TILES * tileStride(ringSize(minSize, guardSize), guardSize));
+	}
+
+	// The ring holds minSize frames, which must not be fewer than guardSize.
+	// The arena must be freshly allocated.
+	void init(int minSize, int guardSize, Arena& arena, const Kernels& kernels) {
+		this->kernels = &kernels;
+		size = ringSize(minSize, guardSize);
+		guard = guardSize;
+
+		// Every tile starts on a cache line
+		stride = tileStride(size, guard);
+		storage = arena.take<float>(TILES * stride);
+		for (int ch = 0; ch < CHANNELS; ch++) buffer[ch] = storage + (ch / TILE) * stride + ch % TILE;
+
+		dirty = 0;
+		clean();
+	}
+
+	void clean() {
+		// The guard region mirrors the start of the ring
+		int mirrored = (dirty < guard) ? dirty : guard;
+		for (int t = 0; t < TILES; t++) {
+			float* x = storage + t * stride;
+			memset(x, 0, dirty * TILE * sizeof(float));
+			memset(x + size * TILE, 0, mirrored * TILE * sizeof(float));
+		}
+		dirty = 0;
+		position = 0;
+		written = 0;
+		for (int ch = 0; ch < CHANNELS; ch++) sound[ch] = -size;
+	}
+
+	// Copy nframes <= guard samples of every input, starting at input[ch] + offset,
+	// to the current position. The copy is contiguous thanks to the guard region,
+	// only writes close to the ring borders have to update the mirror.
+	void write(const std::array<float*, CHANNELS>& input, int offset, int nframes) {
+		for (int ch = 0; ch < CHANNELS; ch++) {
+			if (copySamples<TILE>(*kernels, buffer[ch] + position * TILE, input[ch] + offset, nframes)) {
+				sound[ch] = written + nframes;
+			}
+		}
+		written += nframes;
+		if (position + nframes > dirty) dirty = (position + nframes < size) ? position + nframes : size;
+
+		for (int t = 0; t < TILES; t++) {
+			float* x = storage + t * stride;
+
+			// Written past the ring: wrap into the start of the ring
+			if (position + nframes > size) {
+				memcpy(x, x + size * TILE, (position + nframes - size) * TILE * sizeof(float));
+			}
+			// Written into the mirrored start: update the guard region
+			if (position < guard) {
+				int end = (position + nframes < guard) ? position + nframes : guard;
+				memcpy(x + (size + position) * TILE, x + position * TILE, (end - position) * TILE * sizeof(float));
+			}
+		}
+	}
+
+	// Move the current position nframes forward
+	void advance(int nframes) {
+		position += nframes;
+		if (position >= size) position -= size;
+	}
+
+	// Ring index of the sample `offset` samples after the current position,
+	// offset lies within [-size, size[
+	int index(int offset) const {
+		int i = position + offset;
+		if (i < 0) return i + size;
+		if (i >= size) return i - size;
+		return i;
+	}
+
+	// Span of up to `guard` samples of channel ch, starting `offset` samples
+	// after the current position (negative offsets lie in the past). Sample f
+	// of the span is at read(ch, offset)[f * STRIDE].
+	const float* read(int ch, int offset) const {
+		return buffer[ch] + index(offset) * TILE;
+	}
+
+	int getSize() const {
+		return size;
+	}
+
+	// All samples of channel ch in the ring are 0
+	bool silent(int ch) const {
+		return written - sound[ch] >= size;
+	}
+
+private:
+	static int ringSize(int minSize, int guardSize) {
+		return (minSize > guardSize) ? minSize : guardSize;
+	}
+
+	// Floats per tile, rounded up to whole cache lines
+	static int tileStride(int size, int guard) {
+		const int align = Arena::ALIGN / sizeof(float);
+		return ((size + guard) * TILE + align - 1) / align * align;
+	}
+
+	const Kernels* kernels = nullptr;
+	float* storage = nullptr;
+	std::array<float*, CHANNELS> buffer;
+
+	int size = 0;
+	// Frames of the ring written since clean()
+	int dirty = 0;
+	int guard = 0;
+	int stride = 0;
+	int position = 0;
+
+	// Frames written since clean(), and per channel the count after its last
+	// non-silent sample
+	long written = 0;
+	std::array<long, CHANNELS> sound;
+};
@@ -0,0 +1,108 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <string.h>
+#include "kernels.hpp"
+
+// The kernels are built for the target of the compiler (SSE2 on x86-64,
+// NEON on ARM64, or whatever OPTFLAGS ask for) in the translation unit of the
+// plugin. On x86 they are also built for AVX2 and AVX-512 in kernels-avx2.cpp
+// and kernels-avx512.cpp. Every instance calls the kernels of the widest
+// instruction set the CPU supports through the table chosenKernels() returns
+// when it is created, so one binary runs everywhere. All tables produce
+// identical results. Build with -DPAN_NO_DISPATCH to only use the kernels
+// of the compiler target.
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(PAN_NO_DISPATCH)
+#define PAN_DISPATCH_X86
+extern const Kernels kernelsAvx2;
+extern const Kernels kernelsAvx512;
+#endif
+
+// The kernels of the compiler target
+inline const Kernels& targetKernels() {
+	static const Kernels kernels = localKernels();
+	return kernels;
+}
+
+// The kernels named name ("avx512", "avx2" or the name of the compiler
+// target), if the CPU supports them
+inline const Kernels* findKernels(const char* name) {
+#ifdef PAN_DISPATCH_X86
+	__builtin_cpu_init();
+	if (!strcmp(name, kernelsAvx512.name)) return __builtin_cpu_supports("avx512f") ? &kernelsAvx512 : nullptr;
+	if (!strcmp(name, kernelsAvx2.name)) return __builtin_cpu_supports("avx2") ? &kernelsAvx2 : nullptr;
+#endif
+	return strcmp(name, targetKernels().name) ? nullptr : &targetKernels();
+}
+
+// The kernels of the widest instruction set the CPU supports
+inline const Kernels& chosenKernels() {
+#ifdef PAN_DISPATCH_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return kernelsAvx512;
+	if (__builtin_cpu_supports("avx2")) return kernelsAvx2;
+#endif
+	return targetKernels();
+}
+
+// Calls of the strided kernels: STRIDE 1 through the table, interleaved
+// tiles of the delay line (and tap counts without an entry) through the
+// kernels of the compiler target
+template <int STRIDE>
+inline bool copySamples(const Kernels& kernels, float* y, const float* x, int n) {
+	if (STRIDE == 1) return kernels.copySamples(y, x, n);
+	return copySamples<STRIDE>(y, x, n);
+}
+
+template <int STRIDE>
+inline void mixStereo(const Kernels& kernels, float* out0, float* out1, const float* in0, const float* in1,
+	float gain0, float gain1, int n) {
+	if (STRIDE == 1) kernels.mixStereo(out0, out1, in0, in1, gain0, gain1, n);
+	else mixStereo<STRIDE>(out0, out1, in0, in1, gain0, gain1, n);
+}
+
+template <int STRIDE>
+inline void mixStereoRamp(const Kernels& kernels, float* out0, float* out1, const float* in0, const float* in1,
+	float gain0, float step0, float gain1, float step1, int n) {
+	if (STRIDE == 1) kernels.mixStereoRamp(out0, out1, in0, in1, gain0, step0, gain1, step1, n);
+	else mixStereoRamp<STRIDE>(out0, out1, in0, in1, gain0, step0, gain1, step1, n);
+}
+
+template <int STRIDE>
+inline void mixStereoInterpolated(const Kernels& kernels, float* out0, float* out1, const float* in0, const float* in1,
+	float frac0, float frac1, float gain0, float gain1, int n) {
+	if (STRIDE == 1) kernels.mixStereoInterpolated(out0, out1, in0, in1, frac0, frac1, gain0, gain1, n);
+	else mixStereoInterpolated<STRIDE>(out0, out1, in0, in1, frac0, frac1, gain0, gain1, n);
+}
+
+template <int TAPS, int STRIDE>
+inline void mixStereoFir(const Kernels& kernels, float* out0, float* out1, const float* in0, const float* in1,
+	const float* coef0, const float* coef1, float gain0, float gain1, int n) {
+	if (STRIDE == 1 && TAPS == 4) kernels.mixStereoFir4(out0, out1, in0, in1, coef0, coef1, gain0, gain1, n);
+	else if (STRIDE == 1 && TAPS == 16) kernels.mixStereoFir16(out0, out1, in0, in1, coef0, coef1, gain0, gain1, n);
+	else mixStereoFir<TAPS, STRIDE>(out0, out1, in0, in1, coef0, coef1, gain0, gain1, n);
+}
+
+template <bool RAMP, int TAPS, int STRIDE>
+inline void mixTaps(const Kernels& kernels, float* out, const float* const* in, const float* gain, const float* step,
+	int n) {
+	if (STRIDE == 1 && TAPS == 6) kernels.mixTaps6[RAMP](out, in, gain, step, n);
+	else if (STRIDE == 1 && TAPS == 12) kernels.mixTaps12[RAMP](out, in, gain, step, n);
+	else mixTaps<RAMP, STRIDE>(out, in, gain, step, TAPS, n);
+}
@@ -0,0 +1,489 @@
+#!/bin/sh
+#
+# Brain's Pan, a LV2 ensemble panner
+# Copyright (c) 2020 Christian Masser
+#
+# Generates manifest.ttl and one panN.ttl per channel count given on the
+# command line. All plugins share the binary pan.so. NxL is the variant with
+# N channels and L listeners, panNxL.ttl.
+#
+# Usage: ./genttl.sh 2 4 5 8 9 9x3
+
+URI=http://github.com/brainstar/lv2
+
+cat > manifest.ttl <<EOF
+@prefix lv2:  <http://lv2plug.in/ns/lv2core#> .
+@prefix doap: <http://usefulinc.com/ns/doap#> .
+@prefix foaf:  <http://xmlns.com/foaf/0.1/> .
+@prefix rdfs: <http://www.w3.org/2000/01/rdf-schema#> .
+
+<http://github.com/brainstar/people>
+	a foaf:Person ;
+	foaf:name "Christian Masser" ;
+	foaf:mbox "mailto:christian.masser@gmail.com" ;
+	rdfs:seeAlso <http://github.com/brainstar> .
+EOF
+
+for name in "$@"; do
+	n=${name%x*}
+	l=1
+	case $name in *x*) l=${name#*x} ;; esac
+
+	cat >> manifest.ttl <<EOF
+
+<$URI/pan$name>
+	a lv2:Plugin ;
+	lv2:binary <pan.so> ;
+	rdfs:seeAlso <pan$name.ttl> .
+EOF
+
+	ttl=pan$name.ttl
+	cat > $ttl <<EOF
+@prefix atom: <http://lv2plug.in/ns/ext/atom#> .
+@prefix bufsz: <http://lv2plug.in/ns/ext/buf-size#> .
+@prefix lv2:  <http://lv2plug.in/ns/lv2core#> .
+@prefix doap: <http://usefulinc.com/ns/doap#> .
+@prefix opts: <http://lv2plug.in/ns/ext/options#> .
+@prefix patch: <http://lv2plug.in/ns/ext/patch#> .
+@prefix rdf:  <http://www.w3.org/1999/02/22-rdf-syntax-ns#> .
+@prefix rdfs: <http://www.w3.org/2000/01/rdf-schema#> .
+@prefix urid: <http://lv2plug.in/ns/ext/urid#> .
+
+<$URI/pan#radius>
+	a lv2:Parameter ;
+	rdfs:label "Radius" ;
+	rdfs:range atom:Float ;
+	lv2:default 5.0 ;
+	lv2:minimum 2.0 ;
+	lv2:maximum 20.0 .
+
+<$URI/pan#pdist>
+	a lv2:Parameter ;
+	rdfs:label "Player Distance" ;
+	rdfs:range atom:Float ;
+	lv2:default 1.0 ;
+	lv2:minimum 0.5 ;
+	lv2:maximum 10.0 .
+
+<$URI/pan#edist>
+	a lv2:Parameter ;
+	rdfs:label "Ear Distance" ;
+	rdfs:range atom:Float ;
+	lv2:default 0.149 ;
+	lv2:minimum 0.01 ;
+	lv2:maximum 1.0 .
+
+<$URI/pan#alpha>
+	a lv2:Parameter ;
+	rdfs:label "Alpha 0" ;
+	rdfs:range atom:Float ;
+	lv2:default 0.0 ;
+	lv2:minimum -90.0 ;
+	lv2:maximum 90.0 .
+
+<$URI/pan#window>
+	a lv2:Parameter ;
+	rdfs:label "Window size" ;
+	rdfs:range atom:Float ;
+	lv2:default 1.0 ;
+	lv2:minimum 0.1 ;
+	lv2:maximum 1.9 .
+
+<$URI/pan#relative_mode>
+	a lv2:Parameter ;
+	rdfs:label "Relative Delays" ;
+	rdfs:range atom:Bool ;
+	lv2:default false .
+
+<$URI/pan$name>
+	a lv2:Plugin ;
+	doap:name "Brain's Pan$name" ;
+	doap:license <http://usefulinc.com/doap/licenses/gpl> ;
+	lv2:optionalFeature lv2:hardRTCapable , urid:map , opts:options ,
+		bufsz:fixedBlockLength , bufsz:powerOf2BlockLength ;
+	opts:supportedOption bufsz:minBlockLength , bufsz:nominalBlockLength ,
+		bufsz:maxBlockLength ;
+	patch:writable <$URI/pan#radius> ,
+		<$URI/pan#pdist> ,
+		<$URI/pan#edist> ,
+		<$URI/pan#alpha> ,
+		<$URI/pan#window> ,
+		<$URI/pan#relative_mode> ;
+	lv2:port [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index 0 ;
+		lv2:symbol "radius" ;
+		lv2:name "Radius" ;
+		lv2:default 5.0 ;
+		lv2:minimum 2.0 ;
+		lv2:maximum 20.0
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index 1 ;
+		lv2:symbol "pdist" ;
+		lv2:name "Player Distance" ;
+		lv2:default 1.0 ;
+		lv2:minimum 0.5 ;
+		lv2:maximum 10.0
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index 2 ;
+		lv2:symbol "edist" ;
+		lv2:name "Ear Distance" ;
+		lv2:default 0.149 ;
+		lv2:minimum 0.01 ;
+		lv2:maximum 1.0
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index 3 ;
+		lv2:symbol "alpha" ;
+		lv2:name "Alpha 0" ;
+		lv2:default 0.0 ;
+		lv2:minimum -90.0 ;
+		lv2:maximum 90.0
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index 4 ;
+		lv2:symbol "window" ;
+		lv2:name "Window size" ;
+		lv2:default 1.0 ;
+		lv2:minimum 0.1 ;
+		lv2:maximum 1.9
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index 5 ;
+		lv2:symbol "relative_mode" ;
+		lv2:name "Relative Delays" ;
+		lv2:minimum 0;
+		lv2:maximum 1;
+		lv2:default 0;
+		lv2:portProperty lv2:toggled
+	] , [
+		a lv2:AudioPort ,
+			lv2:OutputPort ;
+		lv2:index 6 ;
+		lv2:symbol "out_left" ;
+		lv2:name "Out Left"
+	] , [
+		a lv2:AudioPort ,
+			lv2:OutputPort ;
+		lv2:index 7 ;
+		lv2:symbol "out_right" ;
+		lv2:name "Out Right"
+EOF
+
+	i=1
+	while [ $i -le $n ]; do
+		cat >> $ttl <<EOF
+	] , [
+		a lv2:AudioPort ,
+			lv2:InputPort ;
+		lv2:index $((7 + i)) ;
+		lv2:symbol "in_$i" ;
+		lv2:name "In $i"
+EOF
+		i=$((i + 1))
+	done
+
+	# Ports after the inputs, their indices depend on the channel count
+	cat >> $ttl <<EOF
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((8 + n)) ;
+		lv2:symbol "interpolation" ;
+		lv2:name "Interpolation" ;
+		lv2:default 0 ;
+		lv2:minimum 0 ;
+		lv2:maximum 2 ;
+		lv2:portProperty lv2:integer , lv2:enumeration ;
+		lv2:scalePoint [ rdfs:label "Linear" ; rdf:value 0 ] ,
+			[ rdfs:label "Cubic Lagrange" ; rdf:value 1 ] ,
+			[ rdfs:label "Windowed sinc" ; rdf:value 2 ]
+EOF
+
+	# Optional telemetry outputs, see Pan::report()
+	# Usage: port <index - n> <symbol> <name> <minimum> <maximum> [property]
+	port() {
+		cat >> $ttl <<EOF
+	] , [
+		a lv2:OutputPort ,
+			lv2:ControlPort ;
+		lv2:index $(($1 + n)) ;
+		lv2:symbol "$2" ;
+		lv2:name "$3" ;
+		lv2:minimum $4 ;
+		lv2:maximum $5 ;
+		lv2:portProperty lv2:connectionOptional$6
+EOF
+	}
+	port 9 load "DSP Load" 0 1
+	port 10 load_peak "DSP Load Peak" 0 1
+	port 11 smoothing "Smoothing" 0 1 " , lv2:toggled"
+	port 12 smoothing_left "Smoothing Frames Left" 0 384000 " , lv2:integer"
+	port 13 min_delay "Min. Delay" 0 65536 " , lv2:integer"
+	port 14 max_delay "Max. Delay" 0 65536 " , lv2:integer"
+	port 15 headroom "Buffer Headroom" 0 65536 " , lv2:integer"
+
+	# Timestamped parameter changes (patch:Set), see PanPlugin::run()
+	cat >> $ttl <<EOF
+	] , [
+		a atom:AtomPort ,
+			lv2:InputPort ;
+		lv2:index $((16 + n)) ;
+		lv2:symbol "events" ;
+		lv2:name "Events" ;
+		atom:bufferType atom:Sequence ;
+		atom:supports patch:Message ;
+		lv2:designation lv2:control ;
+		lv2:portProperty lv2:connectionOptional
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((17 + n)) ;
+		lv2:symbol "layout" ;
+		lv2:name "Layout" ;
+		lv2:default 0 ;
+		lv2:minimum 0 ;
+		lv2:maximum 1 ;
+		lv2:portProperty lv2:integer , lv2:enumeration ;
+		lv2:scalePoint [ rdfs:label "Arc" ; rdf:value 0 ] ,
+			[ rdfs:label "Sources" ; rdf:value 1 ]
+EOF
+
+	# Placement of every source in the sources layout
+	i=1
+	while [ $i -le $n ]; do
+		cat >> $ttl <<EOF
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((16 + n + 2 * i)) ;
+		lv2:symbol "azimuth_$i" ;
+		lv2:name "Azimuth $i" ;
+		lv2:default 0.0 ;
+		lv2:minimum -180.0 ;
+		lv2:maximum 180.0
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((17 + n + 2 * i)) ;
+		lv2:symbol "distance_$i" ;
+		lv2:name "Distance $i" ;
+		lv2:default 5.0 ;
+		lv2:minimum 0.5 ;
+		lv2:maximum 20.0
+EOF
+		i=$((i + 1))
+	done
+
+	cat >> $ttl <<EOF
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((18 + 3 * n)) ;
+		lv2:symbol "delay_mode" ;
+		lv2:name "Delay Changes" ;
+		lv2:default 0 ;
+		lv2:minimum 0 ;
+		lv2:maximum 1 ;
+		lv2:portProperty lv2:integer , lv2:enumeration ;
+		lv2:scalePoint [ rdfs:label "Glide" ; rdf:value 0 ] ,
+			[ rdfs:label "Crossfade" ; rdf:value 1 ]
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((19 + 3 * n)) ;
+		lv2:symbol "fade_time" ;
+		lv2:name "Crossfade Time" ;
+		lv2:default 20.0 ;
+		lv2:minimum 1.0 ;
+		lv2:maximum 500.0
+EOF
+
+	# Output pair and position of every further listener, see Pan::LISTENER_PORTS
+	j=2
+	while [ $j -le $l ]; do
+		base=$((20 + 3 * n + 5 * (j - 2)))
+		cat >> $ttl <<EOF
+	] , [
+		a lv2:AudioPort ,
+			lv2:OutputPort ;
+		lv2:index $base ;
+		lv2:symbol "out_left_$j" ;
+		lv2:name "Out Left $j"
+	] , [
+		a lv2:AudioPort ,
+			lv2:OutputPort ;
+		lv2:index $((base + 1)) ;
+		lv2:symbol "out_right_$j" ;
+		lv2:name "Out Right $j"
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 2)) ;
+		lv2:symbol "listener_x_$j" ;
+		lv2:name "Listener $j X" ;
+		lv2:default 0.0 ;
+		lv2:minimum -10.0 ;
+		lv2:maximum 10.0
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 3)) ;
+		lv2:symbol "listener_y_$j" ;
+		lv2:name "Listener $j Y" ;
+		lv2:default 0.0 ;
+		lv2:minimum -10.0 ;
+		lv2:maximum 10.0
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 4)) ;
+		lv2:symbol "listener_heading_$j" ;
+		lv2:name "Listener $j Heading" ;
+		lv2:default 0.0 ;
+		lv2:minimum -180.0 ;
+		lv2:maximum 180.0
+EOF
+		j=$((j + 1))
+	done
+
+	# Head filters and the latency they add, see Pan::filterVoices()
+	base=$((20 + 3 * n + 5 * (l - 1)))
+	cat >> $ttl <<EOF
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $base ;
+		lv2:symbol "binaural" ;
+		lv2:name "Binaural" ;
+		lv2:default 0 ;
+		lv2:minimum 0 ;
+		lv2:maximum 1 ;
+		lv2:portProperty lv2:toggled
+	] , [
+		a lv2:OutputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 1)) ;
+		lv2:symbol "latency" ;
+		lv2:name "Latency" ;
+		lv2:minimum 0 ;
+		lv2:maximum 64 ;
+		lv2:designation lv2:latency ;
+		lv2:portProperty lv2:reportsLatency , lv2:integer , lv2:connectionOptional
+EOF
+
+	# Early reflections of a room around every listener, see Geometry::setRoom()
+	cat >> $ttl <<EOF
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 2)) ;
+		lv2:symbol "early_reflections" ;
+		lv2:name "Early Reflections" ;
+		lv2:default 0 ;
+		lv2:minimum 0 ;
+		lv2:maximum 1 ;
+		lv2:portProperty lv2:toggled
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 3)) ;
+		lv2:symbol "room_width" ;
+		lv2:name "Room Width" ;
+		lv2:default 12.0 ;
+		lv2:minimum 2.0 ;
+		lv2:maximum 30.0
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 4)) ;
+		lv2:symbol "room_depth" ;
+		lv2:name "Room Depth" ;
+		lv2:default 16.0 ;
+		lv2:minimum 2.0 ;
+		lv2:maximum 30.0
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 5)) ;
+		lv2:symbol "room_height" ;
+		lv2:name "Room Height" ;
+		lv2:default 5.0 ;
+		lv2:minimum 2.5 ;
+		lv2:maximum 15.0
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 6)) ;
+		lv2:symbol "absorption" ;
+		lv2:name "Absorption" ;
+		lv2:default 0.3 ;
+		lv2:minimum 0.0 ;
+		lv2:maximum 1.0
+EOF
+
+	# High frequency loss of every path in the air, see airabsorption.hpp
+	cat >> $ttl <<EOF
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 7)) ;
+		lv2:symbol "air_absorption" ;
+		lv2:name "Air Absorption" ;
+		lv2:default 0 ;
+		lv2:minimum 0 ;
+		lv2:maximum 1 ;
+		lv2:portProperty lv2:toggled
+EOF
+
+	# Surround formats of the center listener, see surround.hpp
+	cat >> $ttl <<EOF
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 8)) ;
+		lv2:symbol "output_format" ;
+		lv2:name "Output Format" ;
+		lv2:default 0 ;
+		lv2:minimum 0 ;
+		lv2:maximum 3 ;
+		lv2:portProperty lv2:integer , lv2:enumeration ;
+		lv2:scalePoint [ rdfs:label "Stereo" ; rdf:value 0 ] ,
+			[ rdfs:label "Ambisonics 1st order" ; rdf:value 1 ] ,
+			[ rdfs:label "Ambisonics 3rd order" ; rdf:value 2 ] ,
+			[ rdfs:label "Speaker ring" ; rdf:value 3 ]
+	] , [
+		a lv2:InputPort ,
+			lv2:ControlPort ;
+		lv2:index $((base + 9)) ;
+		lv2:symbol "speakers" ;
+		lv2:name "Speakers" ;
+		lv2:default 8 ;
+		lv2:minimum 3 ;
+		lv2:maximum 16 ;
+		lv2:portProperty lv2:integer
+EOF
+	i=1
+	while [ $i -le 16 ]; do
+		cat >> $ttl <<EOF
+	] , [
+		a lv2:AudioPort ,
+			lv2:OutputPort ;
+		lv2:index $((base + 9 + i)) ;
+		lv2:symbol "surround_$i" ;
+		lv2:name "Surround $i" ;
+		lv2:portProperty lv2:connectionOptional
+EOF
+		i=$((i + 1))
+	done
+
+	echo "	] ." >> $ttl
+done
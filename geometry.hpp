@@ -0,0 +1,372 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <array>
+#include <math.h>
+
+// Layouts, values of the layout control port
+enum Layout {
+	LAYOUT_ARC = 0,
+	LAYOUT_SOURCES = 1
+};
+
+// Delays and attenuations of CHANNELS sources in front of two ears. The
+// ears belong to a listener, by default at the center facing front. The
+// sources are either spread evenly on an arc (LAYOUT_ARC) or placed one by
+// one with setSource() (LAYOUT_SOURCES). The computation is split into
+// stages, every stage keeps its results:
+//
+//   SPACING    unit vectors and distances to the center of all sources for
+//              alpha 0 = 0 (radius and player distance, or the sources)
+//   ROTATION   unit vectors turned by alpha 0 (alpha 0)
+//   DISTANCES  distances of the sources to both ears (radius, ear distance,
+//              listener)
+//   DELAYS     sample delays and attenuations (relative delays, in the
+//              sources layout also the radius), and those of the early
+//              reflections (room)
+//
+// update() only runs the stages from the first one whose inputs changed,
+// sources moved by setSource() only run the first three stages for
+// themselves.
+// The per-source loops have no branches and no calls besides sqrt and
+// floor, so the compiler can vectorize them across channels (sqrt needs
+// -fno-math-errno, see the Makefile).
+template <int CHANNELS>
+class Geometry {
+public:
+	void init(double sampleRate, double vAir) {
+		samplesPerMeter = sampleRate / vAir;
+		// Nothing is valid yet, the first update() runs all stages
+		radius = playerDistance = earDistance = alpha0 = NAN;
+		relativeDelays = false;
+		layout = LAYOUT_ARC;
+		for (int i = 0; i < CHANNELS; i++) {
+			azimuth[i] = 0.f;
+			distance[i] = 5.f;
+			moved[i] = false;
+			// Straight ahead until the first update()
+			reach[i] = 0.0;
+			unitX[i] = 0.0;
+			unitY[i] = 1.0;
+		}
+		anyMoved = false;
+		listenerX = listenerY = listenerHeading = 0.f;
+		listenerMoved = false;
+		roomWidth = roomDepth = roomHeight = absorption = 0.f;
+		roomChanged = false;
+		for (int e = 0; e < 2; e++) {
+			for (int i = 0; i < CHANNELS; i++) {
+				for (int w = 0; w < WALLS; w++) {
+					reflectionDelay[e][i][w] = 0;
+					reflectionGain[e][i][w] = 0.f;
+				}
+			}
+		}
+	}
+
+	// Early reflections of a room of width x depth x height m centered on the
+	// center listener, whose walls reflect 1 - absorption of the energy. A
+	// width of 0 turns them off. Returns whether the room changed.
+	bool setRoom(float width, float depth, float height, float absorb) {
+		if (width == roomWidth && depth == roomDepth && height == roomHeight && absorb == absorption) return false;
+		roomWidth = width;
+		roomDepth = depth;
+		roomHeight = height;
+		absorption = absorb;
+		roomChanged = true;
+		return true;
+	}
+
+	// Place the listener at (x, y) in m from the center (x to the right, y to
+	// the front), facing heading degrees to the right. Returns whether the
+	// listener moved.
+	bool setListener(float x, float y, float heading) {
+		if (x == listenerX && y == listenerY && heading == listenerHeading) return false;
+		listenerX = x;
+		listenerY = y;
+		listenerHeading = heading;
+		listenerMoved = true;
+		return true;
+	}
+
+	void setLayout(int mode) {
+		if (mode == layout) return;
+		layout = mode;
+		radius = NAN;
+	}
+
+	// Place source i in the sources layout, azimuth in degrees (0 = front,
+	// positive to the right), distance in m from the center
+	void setSource(int i, float a, float d) {
+		azimuth[i] = a;
+		distance[i] = d;
+		moved[i] = true;
+		anyMoved = true;
+	}
+
+	// Set the parameters, alpha0 in degrees. On the arc a reference geometry
+	// lends its normalization, so that listeners away from the center hear
+	// the level differences to the reference listener, see delays().
+	void update(float r, float pdist, float eardist, float a0, bool relative, const Geometry* reference = nullptr) {
+		this->reference = reference;
+		if (r == 0) r = 0.01f;
+
+		bool arc = (layout == LAYOUT_ARC);
+		int stage = STAGES;
+		if (relative != relativeDelays || roomChanged) stage = DELAYS;
+		if (!arc && r != radius) stage = DELAYS;
+		if (eardist != earDistance || listenerMoved) stage = DISTANCES;
+		if (a0 != alpha0) stage = ROTATION;
+		if (isnan(radius) || (arc && (r != radius || pdist != playerDistance))) stage = SPACING;
+		// Sources only matter in their layout, and are moved by SPACING anyway
+		if (!arc && stage > SPACING && anyMoved) {
+			for (int i = 0; i < CHANNELS; i++) {
+				if (!moved[i]) continue;
+				place(i);
+				if (stage > ROTATION) turn(i);
+				if (stage > DISTANCES) measure(i);
+			}
+			stage = (stage < DELAYS) ? stage : DELAYS;
+		}
+		for (int i = 0; i < CHANNELS; i++) moved[i] = false;
+		anyMoved = false;
+		listenerMoved = false;
+		roomChanged = false;
+
+		radius = r;
+		playerDistance = pdist;
+		earDistance = eardist;
+		alpha0 = a0;
+		relativeDelays = relative;
+
+		if (stage <= SPACING) {
+			if (arc) spacing();
+			else for (int i = 0; i < CHANNELS; i++) place(i);
+		}
+		if (stage <= ROTATION) rotation();
+		if (stage <= DISTANCES) {
+			ears();
+			for (int i = 0; i < CHANNELS; i++) measure(i);
+		}
+		if (stage <= DELAYS) delays();
+	}
+
+	// Direction of source i as seen by the listener in degrees (0 = ahead,
+	// positive to the right), valid after update()
+	float direction(int i) const {
+		double x = reach[i] * unitX[i] - listenerX;
+		double y = reach[i] * unitY[i] - listenerY;
+		return remainder(atan2(x, y) / M_PI * 180.0 - listenerHeading, 360.0);
+	}
+
+	// Distance of source i to ear e in m
+	float pathLength(int e, int i) const {
+		return dist[e][i];
+	}
+
+	std::array<std::array<int, CHANNELS>, 2> delay;
+	std::array<std::array<float, CHANNELS>, 2> attenuation;
+
+	// First order image sources of the room: walls to the left, right, back
+	// and front, the floor and the ceiling. The ears are EAR_HEIGHT above
+	// the floor, the sources at the height of the ears.
+	static const int WALLS = 6;
+	static constexpr double EAR_HEIGHT = 1.2;
+	std::array<std::array<std::array<int, WALLS>, CHANNELS>, 2> reflectionDelay;
+	std::array<std::array<std::array<float, WALLS>, CHANNELS>, 2> reflectionGain;
+
+private:
+	enum Stage {
+		SPACING,
+		ROTATION,
+		DISTANCES,
+		DELAYS,
+		STAGES
+	};
+
+	// Unit vectors of the sources for alpha 0 = 0 (x to the right, y to the
+	// front), symmetric to the center. Consecutive sources are alpha apart,
+	// so every vector is its neighbour turned by alpha: two sin/cos pairs
+	// per update instead of one per source.
+	void spacing() {
+		for (int i = 0; i < CHANNELS; i++) reach[i] = radius;
+
+		double alpha = (playerDistance > 2 * radius) ? M_PI : (2 * asin(playerDistance / (2.0 * radius)));
+		double stepX = sin(alpha);
+		double stepY = cos(alpha);
+
+		int center = CHANNELS / 2;
+		double x, y;
+		if (CHANNELS % 2 == 0) {
+			// The center lies between two sources
+			x = sin(alpha / 2);
+			y = cos(alpha / 2);
+		} else {
+			x = 0.0;
+			y = 1.0;
+		}
+		for (int i = center; i < CHANNELS; i++) {
+			baseX[i] = x;
+			baseY[i] = y;
+			baseX[CHANNELS - 1 - i] = -x;
+			baseY[CHANNELS - 1 - i] = y;
+			double turned = x * stepY + y * stepX;
+			y = y * stepY - x * stepX;
+			x = turned;
+		}
+	}
+
+	// Unit vector and distance of source i in the sources layout
+	void place(int i) {
+		double a = azimuth[i] / 180.0 * M_PI;
+		baseX[i] = sin(a);
+		baseY[i] = cos(a);
+		reach[i] = distance[i];
+	}
+
+	void rotation() {
+		double a = alpha0 / 180.0 * M_PI;
+		turnX = sin(a);
+		turnY = cos(a);
+		for (int i = 0; i < CHANNELS; i++) turn(i);
+	}
+
+	void turn(int i) {
+		unitX[i] = baseX[i] * turnY + baseY[i] * turnX;
+		unitY[i] = baseY[i] * turnY - baseX[i] * turnX;
+	}
+
+	// Positions of the ears, half the ear distance to the left and to the right
+	// of the listener
+	void ears() {
+		double half = earDistance / 2.0;
+		double h = listenerHeading / 180.0 * M_PI;
+		double rightX = half * cos(h);
+		double rightY = -half * sin(h);
+		earX[0] = listenerX - rightX;
+		earY[0] = listenerY - rightY;
+		earX[1] = listenerX + rightX;
+		earY[1] = listenerY + rightY;
+	}
+
+	// Distances of source i to both ears
+	void measure(int i) {
+		double x = reach[i] * unitX[i];
+		double y = reach[i] * unitY[i];
+		dist[0][i] = sqrt((x - earX[0]) * (x - earX[0]) + (y - earY[0]) * (y - earY[0]));
+		dist[1][i] = sqrt((x - earX[1]) * (x - earX[1]) + (y - earY[1]) * (y - earY[1]));
+	}
+
+	void delays() {
+		// Attenuations relative to a source at the radius. On the arc they
+		// are normalized by their product, placed sources keep their level
+		// differences.
+		double att = 1.0;
+		for (int e = 0; e < 2; e++) {
+			for (int i = 0; i < CHANNELS; i++) {
+				gain[e][i] = radius / dist[e][i];
+				att *= gain[e][i];
+			}
+		}
+		att = (layout == LAYOUT_ARC) ? 1.0 / att : 1.0;
+		if (reference) att = reference->normalization;
+		normalization = att;
+
+		for (int e = 0; e < 2; e++) {
+			for (int i = 0; i < CHANNELS; i++) {
+				attenuation[e][i] = gain[e][i] * att;
+				delay[e][i] = (int) floor(dist[e][i] * samplesPerMeter + 0.5);
+			}
+		}
+		int min = 0;
+		if (relativeDelays) {
+			// Reduce to relative delay between sources only
+			min = delay[0][0];
+			for (int e = 0; e < 2; e++) {
+				for (int i = 0; i < CHANNELS; i++) {
+					if (delay[e][i] < min) min = delay[e][i];
+				}
+			}
+			for (int e = 0; e < 2; e++) {
+				for (int i = 0; i < CHANNELS; i++) delay[e][i] -= min;
+			}
+		}
+		reflections(min);
+	}
+
+	// Paths from the image sources to the ears, shortened by shift samples
+	// like the direct paths. A reflection has the attenuation of the direct
+	// path, times the reflection coefficient and the ratio of the distances.
+	// The walls only mirror a source and an ear that are both inside the
+	// room, otherwise the images are silent. An image outside may be closer
+	// than every direct path, its delay is clamped to 0 so that it never
+	// reads ahead of the delay line.
+	void reflections(int shift) {
+		bool on = (roomWidth > 0.f);
+		double coefficient = sqrt(1.0 - absorption);
+		double halfWidth = roomWidth / 2.0;
+		double halfDepth = roomDepth / 2.0;
+		double floor2 = 2.0 * EAR_HEIGHT;
+		double ceiling2 = 2.0 * (roomHeight - EAR_HEIGHT);
+		for (int e = 0; e < 2; e++) {
+			for (int i = 0; i < CHANNELS; i++) {
+				double x = reach[i] * unitX[i];
+				double y = reach[i] * unitY[i];
+				double dx = x - earX[e];
+				double dy = y - earY[e];
+				bool inside = fabs(x) <= halfWidth && fabs(y) <= halfDepth
+					&& fabs(earX[e]) <= halfWidth && fabs(earY[e]) <= halfDepth;
+				// Horizontal offsets of the images, and the vertical ones
+				double imageX[WALLS] = { -2.0 * halfWidth - x - earX[e], 2.0 * halfWidth - x - earX[e], dx, dx, dx, dx };
+				double imageY[WALLS] = { dy, dy, -2.0 * halfDepth - y - earY[e], 2.0 * halfDepth - y - earY[e], dy, dy };
+				double imageZ[WALLS] = { 0.0, 0.0, 0.0, 0.0, floor2, ceiling2 };
+				for (int w = 0; w < WALLS; w++) {
+					double path = sqrt(imageX[w] * imageX[w] + imageY[w] * imageY[w] + imageZ[w] * imageZ[w]);
+					int delay = (int) floor(path * samplesPerMeter + 0.5) - shift;
+					reflectionDelay[e][i][w] = (delay > 0) ? delay : 0;
+					reflectionGain[e][i][w] = (on && inside) ? attenuation[e][i] * coefficient * dist[e][i] / path : 0.f;
+				}
+			}
+		}
+	}
+
+	double samplesPerMeter;
+	const Geometry* reference;
+	double normalization;
+
+	float radius, playerDistance, earDistance, alpha0;
+	bool relativeDelays;
+	int layout;
+
+	std::array<float, CHANNELS> azimuth, distance;
+	std::array<bool, CHANNELS> moved;
+	bool anyMoved;
+
+	float listenerX, listenerY, listenerHeading;
+	bool listenerMoved;
+	float roomWidth, roomDepth, roomHeight, absorption;
+	bool roomChanged;
+	double earX[2], earY[2];
+
+	double turnX, turnY;
+	std::array<double, CHANNELS> baseX, baseY, reach;
+	std::array<double, CHANNELS> unitX, unitY;
+	std::array<std::array<double, CHANNELS>, 2> dist;
+	std::array<std::array<double, CHANNELS>, 2> gain;
+};
@@ -0,0 +1,115 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <array>
+#include <math.h>
+#include <vector>
+#include "arena.hpp"
+#include "convolution.hpp"
+
+// Head-related filters of the right ear for sources in the horizontal plane,
+// one every STEP degrees, after the structural model of Brown and Duda
+// (A Structural Model for Binaural Sound Synthesis, 1998): the shadow of a
+// spherical head, a one-pole one-zero shelf whose treble rises towards the
+// ear and falls behind the head, followed by the echoes of the pinna. The
+// interaural delay is not part of the filters, Pan already delays every ear.
+// The left ear uses the filter of the mirrored direction. All filters pass
+// low frequencies unchanged, so the levels of the panner stay as they are.
+class HeadFilters {
+public:
+	static const int STEP = 5;
+	static const int DIRECTIONS = 360 / STEP;
+
+	// Arena bytes of the filters at sampleRate
+	static size_t bytes(double sampleRate) {
+		return DIRECTIONS * Convolution::Filter::bytes(ceil(LENGTH * sampleRate));
+	}
+
+	void init(const Convolution& fft, double sampleRate, double vAir, Arena& arena) {
+		int length = ceil(LENGTH * sampleRate);
+		std::vector<float> response(length);
+		for (int d = 0; d < DIRECTIONS; d++) {
+			design(response.data(), length, d * STEP, sampleRate, vAir);
+			filters[d].init(fft, response.data(), length, arena);
+		}
+	}
+
+	// Partitions of every filter at sampleRate
+	static int partitions(double sampleRate) {
+		return Convolution::partitions(ceil(LENGTH * sampleRate));
+	}
+
+	// Index of the filter of the right ear for a source at azimuth degrees
+	// (0 = front, positive to the right)
+	static int index(float azimuth) {
+		int d = (int) lroundf(azimuth / STEP) % DIRECTIONS;
+		return (d < 0) ? d + DIRECTIONS : d;
+	}
+
+	const Convolution::Filter& get(int index) const {
+		return filters[index];
+	}
+
+private:
+	// Length of the responses in seconds, the head shadow has decayed by
+	// more than 80 dB and the last pinna echo is in
+	static constexpr double LENGTH = 0.003;
+	// Radius of an average head in m
+	static constexpr double HEAD_RADIUS = 0.0875;
+
+	static void design(float* response, int length, double azimuth, double sampleRate, double vAir) {
+		double theta = remainder(azimuth, 360.0);
+		// Angle between the right ear and the source, 0 to 180 degrees
+		double incidence = fabs(remainder(azimuth - 90.0, 360.0));
+		// Treble gain of the shelf, 2 towards the ear, 0.1 at 150 degrees
+		const double alphaMin = 0.1;
+		const double thetaMin = 150.0;
+		double alpha = (1.0 + alphaMin / 2) + (1.0 - alphaMin / 2) * cos(incidence / thetaMin * M_PI);
+
+		// H(s) = (alpha s + beta) / (s + beta), bilinear transform
+		double beta = 2.0 * vAir / HEAD_RADIUS;
+		double k = 2.0 * sampleRate;
+		double b0 = (beta + alpha * k) / (beta + k);
+		double b1 = (beta - alpha * k) / (beta + k);
+		double a1 = (beta - k) / (beta + k);
+		std::vector<double> shadow(length);
+		double previous = 0.0;
+		for (int n = 0; n < length; n++) {
+			double x = (n == 0) ? 1.0 : 0.0;
+			double y = b0 * x + previous;
+			previous = b1 * x - a1 * y;
+			shadow[n] = y;
+		}
+
+		// Pinna echoes, delays in samples at 44.1 kHz. The reflection
+		// coefficients sum to 0, the echoes leave low frequencies alone.
+		const double rho[5] = { 0.5, -1.0, 0.5, -0.25, 0.25 };
+		const double a[5] = { 1.0, 5.0, 5.0, 5.0, 5.0 };
+		const double b[5] = { 2.0, 4.0, 7.0, 11.0, 13.0 };
+		const double d[5] = { 1.0, 0.5, 0.5, 0.5, 0.5 };
+		for (int n = 0; n < length; n++) response[n] = shadow[n];
+		for (int e = 0; e < 5; e++) {
+			double tau = a[e] * cos(theta / 2.0 / 180.0 * M_PI) * sin(d[e] * M_PI / 2) + b[e];
+			int delay = (int) lround(tau * sampleRate / 44100.0);
+			for (int n = delay; n < length; n++) response[n] += rho[e] * shadow[n - delay];
+		}
+	}
+
+	std::array<Convolution::Filter, DIRECTIONS> filters;
+};
@@ -0,0 +1,110 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <math.h>
+
+// Interpolation modes, values of the interpolation control port
+enum Interpolation {
+	INTERPOLATION_LINEAR = 0,
+	INTERPOLATION_CUBIC = 1,
+	INTERPOLATION_SINC = 2
+};
+
+// Polyphase coefficient table of a TAPS point fractional delay interpolator.
+// The fractional part of the delay is quantized to PHASES steps. Tap k
+// weighs the sample k - (TAPS / 2 - 1) positions after the integer part, so
+// a read for a position i + frac starts TAPS / 2 - 1 samples before i.
+template <int TAPS>
+class PolyphaseTable {
+public:
+	static const int PHASES = 512;
+	static const int BEFORE = TAPS / 2 - 1;
+
+	// Coefficients for the fractional part frac in [0, 1]
+	const float* get(float frac) const {
+		return coefficients[(int) (frac * PHASES + 0.5f)];
+	}
+
+protected:
+	// Distance between tap k and the interpolated position
+	static double distance(int k, int phase) {
+		return (k - BEFORE) - (double) phase / PHASES;
+	}
+
+	float coefficients[PHASES + 1][TAPS];
+};
+
+// 4 point, 3rd order Lagrange interpolation
+class LagrangeTable : public PolyphaseTable<4> {
+public:
+	LagrangeTable() {
+		for (int p = 0; p <= PHASES; p++) {
+			for (int k = 0; k < 4; k++) {
+				double c = 1.0;
+				for (int j = 0; j < 4; j++) {
+					if (j != k) c *= distance(j, p) / (distance(j, p) - distance(k, p));
+				}
+				coefficients[p][k] = c;
+			}
+		}
+	}
+};
+
+// 16 point Kaiser windowed sinc interpolation
+class SincTable : public PolyphaseTable<16> {
+public:
+	SincTable() {
+		const double beta = 7.0;
+		for (int p = 0; p <= PHASES; p++) {
+			double sum = 0.0;
+			double c[16];
+			for (int k = 0; k < 16; k++) {
+				double t = distance(k, p);
+				double w = t / 8.0;
+				double window = (w * w < 1.0) ? besselI0(beta * sqrt(1.0 - w * w)) / besselI0(beta) : 0.0;
+				c[k] = ((t == 0.0) ? 1.0 : sin(M_PI * t) / (M_PI * t)) * window;
+				sum += c[k];
+			}
+			// Normalize to unity gain at DC
+			for (int k = 0; k < 16; k++) coefficients[p][k] = c[k] / sum;
+		}
+	}
+
+private:
+	// Modified Bessel function of the first kind, order 0
+	static double besselI0(double x) {
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 32; k++) {
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+};
+
+// The tables do not depend on the sample rate, all instances share them
+inline const LagrangeTable& lagrangeTable() {
+	static const LagrangeTable table;
+	return table;
+}
+
+inline const SincTable& sincTable() {
+	static const SincTable table;
+	return table;
+}
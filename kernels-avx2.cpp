@@ -15,38 +15,9 @@
  * For a full copy of the GNU General Public License see the LICENSE file.
  */
 
-#include "pan.hpp"
-#include <lvtk/plugin.hpp>
+// The kernels built for AVX2, see dispatch.hpp. The Makefile compiles this
+// file with -mavx2.
 
-#define PAN_URI "http://github.com/brainstar/lv2/pan4"
+#include "kernels.hpp"
 
-class Pan4 : public Pan, public lvtk::Plugin<Pan4> {
-public:
-	Pan4(const lvtk::Args &args) : Plugin(args) {
-		sample_rate = static_cast<float> (args.sample_rate);
-		CHANNELS = 4;
-
-		init((int) args.sample_rate);
-	}
-
-	~Pan4() { }
-
-	void connect_port(uint32_t port, void* data) {
-		connect_portBase(port, data);
-	}
-
-	void activate() {
-		activateBase();
-	}
-
-	void deactivate() {
-		deactivateBase();
-	}
-
-	void run(uint32_t nframes) {
-		runBase(nframes);
-	}
-};
-
-
-static const lvtk::Descriptor<Pan4> pan (PAN_URI);
\ No newline at end of file
+extern const Kernels kernelsAvx2 = localKernels();
@@ -15,38 +15,9 @@
  * For a full copy of the GNU General Public License see the LICENSE file.
  */
 
-#include "pan.hpp"
-#include <lvtk/plugin.hpp>
+// The kernels built for AVX-512, see dispatch.hpp. The Makefile compiles this
+// file with -mavx512f.
 
-#define PAN_URI "http://github.com/brainstar/lv2/pan5"
+#include "kernels.hpp"
 
-class Pan5 : public Pan, public lvtk::Plugin<Pan5> {
-public:
-	Pan5(const lvtk::Args &args) : Plugin(args) {
-		sample_rate = static_cast<float> (args.sample_rate);
-		CHANNELS = 5;
-
-		init((int) args.sample_rate);
-	}
-
-	~Pan5() { }
-
-	void connect_port(uint32_t port, void* data) {
-		connect_portBase(port, data);
-	}
-
-	void activate() {
-		activateBase();
-	}
-
-	void deactivate() {
-		deactivateBase();
-	}
-
-	void run(uint32_t nframes) {
-		runBase(nframes);
-	}
-};
-
-
-static const lvtk::Descriptor<Pan5> pan (PAN_URI);
\ No newline at end of file
+extern const Kernels kernelsAvx512 = localKernels();
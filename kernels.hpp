@@ -0,0 +1,584 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include <cstdint>
+#include <string.h>
+
+// Block kernels for the output mix. The vector and the scalar versions use
+// separate multiplies and adds, so they produce identical results.
+// STRIDE is the distance of consecutive input samples in floats, see
+// DelayLine. Strided inputs take the scalar path.
+//
+// This file is compiled once for every instruction set the plugin selects
+// at run time, see dispatch.hpp. The kernels are static, so that every
+// translation unit keeps its own copies, built with its own flags.
+
+// Name of the instruction set of this translation unit
+#if defined(__AVX512F__)
+#define KERNELS_NAME "avx512"
+#elif defined(__AVX2__)
+#define KERNELS_NAME "avx2"
+#elif defined(__AVX__)
+#define KERNELS_NAME "avx"
+#elif defined(__SSE2__)
+#define KERNELS_NAME "sse2"
+#elif defined(__ARM_NEON)
+#define KERNELS_NAME "neon"
+#else
+#define KERNELS_NAME "generic"
+#endif
+
+// Accumulate one channel into both ears:
+// out0[f] += gain0 * in0[f], out1[f] += gain1 * in1[f] for f in [0, n[
+template <int STRIDE = 1>
+static inline void mixStereo(float* out0, float* out1, const float* in0, const float* in1,
+	float gain0, float gain1, int n) {
+	int f = 0;
+#if defined(__AVX512F__)
+	for (; STRIDE == 1 && f + 16 <= n; f += 16) {
+		__m512 o0 = _mm512_loadu_ps(out0 + f);
+		__m512 o1 = _mm512_loadu_ps(out1 + f);
+		o0 = _mm512_add_ps(o0, _mm512_mul_ps(_mm512_loadu_ps(in0 + f), _mm512_set1_ps(gain0)));
+		o1 = _mm512_add_ps(o1, _mm512_mul_ps(_mm512_loadu_ps(in1 + f), _mm512_set1_ps(gain1)));
+		_mm512_storeu_ps(out0 + f, o0);
+		_mm512_storeu_ps(out1 + f, o1);
+	}
+#endif
+#if defined(__AVX__)
+	const __m256 g0 = _mm256_set1_ps(gain0);
+	const __m256 g1 = _mm256_set1_ps(gain1);
+	for (; STRIDE == 1 && f + 8 <= n; f += 8) {
+		__m256 o0 = _mm256_loadu_ps(out0 + f);
+		__m256 o1 = _mm256_loadu_ps(out1 + f);
+		o0 = _mm256_add_ps(o0, _mm256_mul_ps(_mm256_loadu_ps(in0 + f), g0));
+		o1 = _mm256_add_ps(o1, _mm256_mul_ps(_mm256_loadu_ps(in1 + f), g1));
+		_mm256_storeu_ps(out0 + f, o0);
+		_mm256_storeu_ps(out1 + f, o1);
+	}
+#elif defined(__SSE__)
+	const __m128 g0 = _mm_set1_ps(gain0);
+	const __m128 g1 = _mm_set1_ps(gain1);
+	for (; STRIDE == 1 && f + 4 <= n; f += 4) {
+		__m128 o0 = _mm_loadu_ps(out0 + f);
+		__m128 o1 = _mm_loadu_ps(out1 + f);
+		o0 = _mm_add_ps(o0, _mm_mul_ps(_mm_loadu_ps(in0 + f), g0));
+		o1 = _mm_add_ps(o1, _mm_mul_ps(_mm_loadu_ps(in1 + f), g1));
+		_mm_storeu_ps(out0 + f, o0);
+		_mm_storeu_ps(out1 + f, o1);
+	}
+#endif
+	// Scalar tail, or everything on targets without SSE
+	for (; f < n; f++) {
+		float p0 = in0[f * STRIDE] * gain0;
+		float p1 = in1[f * STRIDE] * gain1;
+		out0[f] += p0;
+		out1[f] += p1;
+	}
+}
+
+// Accumulate one channel into both ears with linearly changing gains:
+// out0[f] += (gain0 + f * step0) * in0[f], same for out1
+template <int STRIDE = 1>
+static inline void mixStereoRamp(float* out0, float* out1, const float* in0, const float* in1,
+	float gain0, float step0, float gain1, float step1, int n) {
+	int f = 0;
+#if defined(__AVX512F__)
+	__m512 frame16 = _mm512_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f,
+		8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f);
+	for (; STRIDE == 1 && f + 16 <= n; f += 16) {
+		__m512 a0 = _mm512_add_ps(_mm512_set1_ps(gain0), _mm512_mul_ps(frame16, _mm512_set1_ps(step0)));
+		__m512 a1 = _mm512_add_ps(_mm512_set1_ps(gain1), _mm512_mul_ps(frame16, _mm512_set1_ps(step1)));
+		_mm512_storeu_ps(out0 + f, _mm512_add_ps(_mm512_loadu_ps(out0 + f), _mm512_mul_ps(_mm512_loadu_ps(in0 + f), a0)));
+		_mm512_storeu_ps(out1 + f, _mm512_add_ps(_mm512_loadu_ps(out1 + f), _mm512_mul_ps(_mm512_loadu_ps(in1 + f), a1)));
+		frame16 = _mm512_add_ps(frame16, _mm512_set1_ps(16.f));
+	}
+#endif
+#if defined(__AVX__)
+	const __m256 g0 = _mm256_set1_ps(gain0);
+	const __m256 g1 = _mm256_set1_ps(gain1);
+	const __m256 s0 = _mm256_set1_ps(step0);
+	const __m256 s1 = _mm256_set1_ps(step1);
+	// Frame numbers from f on, exact in floats
+	__m256 frame = _mm256_add_ps(_mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f), _mm256_set1_ps(f));
+	for (; STRIDE == 1 && f + 8 <= n; f += 8) {
+		__m256 a0 = _mm256_add_ps(g0, _mm256_mul_ps(frame, s0));
+		__m256 a1 = _mm256_add_ps(g1, _mm256_mul_ps(frame, s1));
+		_mm256_storeu_ps(out0 + f, _mm256_add_ps(_mm256_loadu_ps(out0 + f), _mm256_mul_ps(_mm256_loadu_ps(in0 + f), a0)));
+		_mm256_storeu_ps(out1 + f, _mm256_add_ps(_mm256_loadu_ps(out1 + f), _mm256_mul_ps(_mm256_loadu_ps(in1 + f), a1)));
+		frame = _mm256_add_ps(frame, _mm256_set1_ps(8.f));
+	}
+#elif defined(__SSE__)
+	const __m128 g0 = _mm_set1_ps(gain0);
+	const __m128 g1 = _mm_set1_ps(gain1);
+	const __m128 s0 = _mm_set1_ps(step0);
+	const __m128 s1 = _mm_set1_ps(step1);
+	__m128 frame = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+	for (; STRIDE == 1 && f + 4 <= n; f += 4) {
+		__m128 a0 = _mm_add_ps(g0, _mm_mul_ps(frame, s0));
+		__m128 a1 = _mm_add_ps(g1, _mm_mul_ps(frame, s1));
+		_mm_storeu_ps(out0 + f, _mm_add_ps(_mm_loadu_ps(out0 + f), _mm_mul_ps(_mm_loadu_ps(in0 + f), a0)));
+		_mm_storeu_ps(out1 + f, _mm_add_ps(_mm_loadu_ps(out1 + f), _mm_mul_ps(_mm_loadu_ps(in1 + f), a1)));
+		frame = _mm_add_ps(frame, _mm_set1_ps(4.f));
+	}
+#endif
+	for (; f < n; f++) {
+		float p0 = in0[f * STRIDE] * (gain0 + f * step0);
+		float p1 = in1[f * STRIDE] * (gain1 + f * step1);
+		out0[f] += p0;
+		out1[f] += p1;
+	}
+}
+
+// Accumulate one channel into both ears, reading in between two samples with
+// fixed weights, i.e. a fractional delay that is constant over n frames:
+// out0[f] += gain0 * (in0[f] * (1 - frac0) + in0[f + 1] * frac0), same for out1
+template <int STRIDE = 1>
+static inline void mixStereoInterpolated(float* out0, float* out1, const float* in0, const float* in1,
+	float frac0, float frac1, float gain0, float gain1, int n) {
+	const float keep0 = 1.f - frac0;
+	const float keep1 = 1.f - frac1;
+	int f = 0;
+#if defined(__AVX512F__)
+	for (; STRIDE == 1 && f + 16 <= n; f += 16) {
+		__m512 x0 = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(in0 + f), _mm512_set1_ps(keep0)),
+			_mm512_mul_ps(_mm512_loadu_ps(in0 + f + 1), _mm512_set1_ps(frac0)));
+		__m512 x1 = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(in1 + f), _mm512_set1_ps(keep1)),
+			_mm512_mul_ps(_mm512_loadu_ps(in1 + f + 1), _mm512_set1_ps(frac1)));
+		_mm512_storeu_ps(out0 + f, _mm512_add_ps(_mm512_loadu_ps(out0 + f), _mm512_mul_ps(x0, _mm512_set1_ps(gain0))));
+		_mm512_storeu_ps(out1 + f, _mm512_add_ps(_mm512_loadu_ps(out1 + f), _mm512_mul_ps(x1, _mm512_set1_ps(gain1))));
+	}
+#endif
+#if defined(__AVX__)
+	const __m256 g0 = _mm256_set1_ps(gain0);
+	const __m256 g1 = _mm256_set1_ps(gain1);
+	const __m256 a0 = _mm256_set1_ps(keep0);
+	const __m256 b0 = _mm256_set1_ps(frac0);
+	const __m256 a1 = _mm256_set1_ps(keep1);
+	const __m256 b1 = _mm256_set1_ps(frac1);
+	for (; STRIDE == 1 && f + 8 <= n; f += 8) {
+		__m256 x0 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in0 + f), a0),
+			_mm256_mul_ps(_mm256_loadu_ps(in0 + f + 1), b0));
+		__m256 x1 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in1 + f), a1),
+			_mm256_mul_ps(_mm256_loadu_ps(in1 + f + 1), b1));
+		_mm256_storeu_ps(out0 + f, _mm256_add_ps(_mm256_loadu_ps(out0 + f), _mm256_mul_ps(x0, g0)));
+		_mm256_storeu_ps(out1 + f, _mm256_add_ps(_mm256_loadu_ps(out1 + f), _mm256_mul_ps(x1, g1)));
+	}
+#elif defined(__SSE__)
+	const __m128 g0 = _mm_set1_ps(gain0);
+	const __m128 g1 = _mm_set1_ps(gain1);
+	const __m128 a0 = _mm_set1_ps(keep0);
+	const __m128 b0 = _mm_set1_ps(frac0);
+	const __m128 a1 = _mm_set1_ps(keep1);
+	const __m128 b1 = _mm_set1_ps(frac1);
+	for (; STRIDE == 1 && f + 4 <= n; f += 4) {
+		__m128 x0 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in0 + f), a0),
+			_mm_mul_ps(_mm_loadu_ps(in0 + f + 1), b0));
+		__m128 x1 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in1 + f), a1),
+			_mm_mul_ps(_mm_loadu_ps(in1 + f + 1), b1));
+		_mm_storeu_ps(out0 + f, _mm_add_ps(_mm_loadu_ps(out0 + f), _mm_mul_ps(x0, g0)));
+		_mm_storeu_ps(out1 + f, _mm_add_ps(_mm_loadu_ps(out1 + f), _mm_mul_ps(x1, g1)));
+	}
+#endif
+	for (; f < n; f++) {
+		float x0 = in0[f * STRIDE] * keep0 + in0[(f + 1) * STRIDE] * frac0;
+		float x1 = in1[f * STRIDE] * keep1 + in1[(f + 1) * STRIDE] * frac1;
+		out0[f] += x0 * gain0;
+		out1[f] += x1 * gain1;
+	}
+}
+
+// Accumulate one channel into both ears through a TAPS point interpolation
+// filter whose coefficients are constant over n frames:
+// out0[f] += gain0 * sum_k coef0[k] * in0[f + k], same for out1
+template <int TAPS, int STRIDE = 1>
+static inline void mixStereoFir(float* out0, float* out1, const float* in0, const float* in1,
+	const float* coef0, const float* coef1, float gain0, float gain1, int n) {
+	// Fold the gains into the coefficients
+	float c0[TAPS], c1[TAPS];
+	for (int k = 0; k < TAPS; k++) {
+		c0[k] = coef0[k] * gain0;
+		c1[k] = coef1[k] * gain1;
+	}
+
+	int f = 0;
+#if defined(__AVX512F__)
+	for (; STRIDE == 1 && f + 16 <= n; f += 16) {
+		__m512 x0 = _mm512_loadu_ps(out0 + f);
+		__m512 x1 = _mm512_loadu_ps(out1 + f);
+		for (int k = 0; k < TAPS; k++) {
+			x0 = _mm512_add_ps(x0, _mm512_mul_ps(_mm512_loadu_ps(in0 + f + k), _mm512_set1_ps(c0[k])));
+			x1 = _mm512_add_ps(x1, _mm512_mul_ps(_mm512_loadu_ps(in1 + f + k), _mm512_set1_ps(c1[k])));
+		}
+		_mm512_storeu_ps(out0 + f, x0);
+		_mm512_storeu_ps(out1 + f, x1);
+	}
+#endif
+#if defined(__AVX__)
+	for (; STRIDE == 1 && f + 8 <= n; f += 8) {
+		__m256 x0 = _mm256_loadu_ps(out0 + f);
+		__m256 x1 = _mm256_loadu_ps(out1 + f);
+		for (int k = 0; k < TAPS; k++) {
+			x0 = _mm256_add_ps(x0, _mm256_mul_ps(_mm256_loadu_ps(in0 + f + k), _mm256_set1_ps(c0[k])));
+			x1 = _mm256_add_ps(x1, _mm256_mul_ps(_mm256_loadu_ps(in1 + f + k), _mm256_set1_ps(c1[k])));
+		}
+		_mm256_storeu_ps(out0 + f, x0);
+		_mm256_storeu_ps(out1 + f, x1);
+	}
+#elif defined(__SSE__)
+	for (; STRIDE == 1 && f + 4 <= n; f += 4) {
+		__m128 x0 = _mm_loadu_ps(out0 + f);
+		__m128 x1 = _mm_loadu_ps(out1 + f);
+		for (int k = 0; k < TAPS; k++) {
+			x0 = _mm_add_ps(x0, _mm_mul_ps(_mm_loadu_ps(in0 + f + k), _mm_set1_ps(c0[k])));
+			x1 = _mm_add_ps(x1, _mm_mul_ps(_mm_loadu_ps(in1 + f + k), _mm_set1_ps(c1[k])));
+		}
+		_mm_storeu_ps(out0 + f, x0);
+		_mm_storeu_ps(out1 + f, x1);
+	}
+#endif
+	for (; f < n; f++) {
+		float x0 = out0[f];
+		float x1 = out1[f];
+		for (int k = 0; k < TAPS; k++) {
+			x0 += in0[(f + k) * STRIDE] * c0[k];
+			x1 += in1[(f + k) * STRIDE] * c1[k];
+		}
+		out0[f] = x0;
+		out1[f] = x1;
+	}
+}
+
+// Accumulate taps reads of one channel into one ear:
+// out[f] += sum_t (gain[t] + f * step[t]) * in[t][f], the gains only change
+// with RAMP. The taps are summed for a vector of frames before it is
+// stored, a list sorted by delay reads the channel in order.
+template <bool RAMP, int STRIDE = 1>
+static inline void mixTaps(float* out, const float* const* in, const float* gain, const float* step,
+	int taps, int n) {
+	int f = 0;
+#if defined(__AVX512F__)
+	__m512 frame16 = _mm512_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f,
+		8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f);
+	for (; STRIDE == 1 && f + 16 <= n; f += 16) {
+		__m512 x = _mm512_loadu_ps(out + f);
+		for (int t = 0; t < taps; t++) {
+			__m512 g = _mm512_set1_ps(gain[t]);
+			if (RAMP) g = _mm512_add_ps(g, _mm512_mul_ps(frame16, _mm512_set1_ps(step[t])));
+			x = _mm512_add_ps(x, _mm512_mul_ps(_mm512_loadu_ps(in[t] + f), g));
+		}
+		_mm512_storeu_ps(out + f, x);
+		if (RAMP) frame16 = _mm512_add_ps(frame16, _mm512_set1_ps(16.f));
+	}
+#endif
+#if defined(__AVX__)
+	__m256 frame = _mm256_add_ps(_mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f), _mm256_set1_ps(f));
+	for (; STRIDE == 1 && f + 8 <= n; f += 8) {
+		__m256 x = _mm256_loadu_ps(out + f);
+		for (int t = 0; t < taps; t++) {
+			__m256 g = _mm256_set1_ps(gain[t]);
+			if (RAMP) g = _mm256_add_ps(g, _mm256_mul_ps(frame, _mm256_set1_ps(step[t])));
+			x = _mm256_add_ps(x, _mm256_mul_ps(_mm256_loadu_ps(in[t] + f), g));
+		}
+		_mm256_storeu_ps(out + f, x);
+		if (RAMP) frame = _mm256_add_ps(frame, _mm256_set1_ps(8.f));
+	}
+#elif defined(__SSE__)
+	__m128 frame = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+	for (; STRIDE == 1 && f + 4 <= n; f += 4) {
+		__m128 x = _mm_loadu_ps(out + f);
+		for (int t = 0; t < taps; t++) {
+			__m128 g = _mm_set1_ps(gain[t]);
+			if (RAMP) g = _mm_add_ps(g, _mm_mul_ps(frame, _mm_set1_ps(step[t])));
+			x = _mm_add_ps(x, _mm_mul_ps(_mm_loadu_ps(in[t] + f), g));
+		}
+		_mm_storeu_ps(out + f, x);
+		if (RAMP) frame = _mm_add_ps(frame, _mm_set1_ps(4.f));
+	}
+#endif
+	for (; f < n; f++) {
+		float x = out[f];
+		for (int t = 0; t < taps; t++) {
+			float g = RAMP ? gain[t] + f * step[t] : gain[t];
+			x += in[t][f * STRIDE] * g;
+		}
+		out[f] = x;
+	}
+}
+
+// mixTaps() with a fixed number of taps, whose loop the compiler unrolls
+template <bool RAMP, int TAPS>
+static void mixTapsFixed(float* out, const float* const* in, const float* gain, const float* step, int n) {
+	mixTaps<RAMP, 1>(out, in, gain, step, TAPS, n);
+}
+
+// Accumulate a gain matrix: out[o][f] += sum_i (gain[i][o] + f * step[i][o]) * in[i][f],
+// the gains only change with RAMP. gain and step are row major, one row of
+// outputs gains per input. The outputs are summed four at a time in
+// registers, every vector of an input is loaded once per four outputs.
+template <bool RAMP>
+static inline void mixMatrix(float* const* out, int outputs, const float* const* in, const float* gain, const float* step,
+	int inputs, int n) {
+	for (int o = 0; o < outputs; o += 4) {
+		int count = (outputs - o < 4) ? outputs - o : 4;
+		int f = 0;
+#if defined(__AVX512F__)
+		__m512 frame16 = _mm512_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f,
+			8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f);
+		for (; f + 16 <= n; f += 16) {
+			__m512 x[4];
+			for (int j = 0; j < count; j++) x[j] = _mm512_loadu_ps(out[o + j] + f);
+			for (int i = 0; i < inputs; i++) {
+				__m512 sample = _mm512_loadu_ps(in[i] + f);
+				for (int j = 0; j < count; j++) {
+					__m512 g = _mm512_set1_ps(gain[i * outputs + o + j]);
+					if (RAMP) g = _mm512_add_ps(g, _mm512_mul_ps(frame16, _mm512_set1_ps(step[i * outputs + o + j])));
+					x[j] = _mm512_add_ps(x[j], _mm512_mul_ps(sample, g));
+				}
+			}
+			for (int j = 0; j < count; j++) _mm512_storeu_ps(out[o + j] + f, x[j]);
+			if (RAMP) frame16 = _mm512_add_ps(frame16, _mm512_set1_ps(16.f));
+		}
+#endif
+#if defined(__AVX__)
+		__m256 frame = _mm256_add_ps(_mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f), _mm256_set1_ps(f));
+		for (; f + 8 <= n; f += 8) {
+			__m256 x[4];
+			for (int j = 0; j < count; j++) x[j] = _mm256_loadu_ps(out[o + j] + f);
+			for (int i = 0; i < inputs; i++) {
+				__m256 sample = _mm256_loadu_ps(in[i] + f);
+				for (int j = 0; j < count; j++) {
+					__m256 g = _mm256_set1_ps(gain[i * outputs + o + j]);
+					if (RAMP) g = _mm256_add_ps(g, _mm256_mul_ps(frame, _mm256_set1_ps(step[i * outputs + o + j])));
+					x[j] = _mm256_add_ps(x[j], _mm256_mul_ps(sample, g));
+				}
+			}
+			for (int j = 0; j < count; j++) _mm256_storeu_ps(out[o + j] + f, x[j]);
+			if (RAMP) frame = _mm256_add_ps(frame, _mm256_set1_ps(8.f));
+		}
+#elif defined(__SSE__)
+		__m128 frame = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+		for (; f + 4 <= n; f += 4) {
+			__m128 x[4];
+			for (int j = 0; j < count; j++) x[j] = _mm_loadu_ps(out[o + j] + f);
+			for (int i = 0; i < inputs; i++) {
+				__m128 sample = _mm_loadu_ps(in[i] + f);
+				for (int j = 0; j < count; j++) {
+					__m128 g = _mm_set1_ps(gain[i * outputs + o + j]);
+					if (RAMP) g = _mm_add_ps(g, _mm_mul_ps(frame, _mm_set1_ps(step[i * outputs + o + j])));
+					x[j] = _mm_add_ps(x[j], _mm_mul_ps(sample, g));
+				}
+			}
+			for (int j = 0; j < count; j++) _mm_storeu_ps(out[o + j] + f, x[j]);
+			if (RAMP) frame = _mm_add_ps(frame, _mm_set1_ps(4.f));
+		}
+#endif
+		for (; f < n; f++) {
+			for (int j = 0; j < count; j++) {
+				float x = out[o + j][f];
+				for (int i = 0; i < inputs; i++) {
+					float g = RAMP ? gain[i * outputs + o + j] + f * step[i * outputs + o + j] : gain[i * outputs + o + j];
+					x += in[i][f] * g;
+				}
+				out[o + j][f] = x;
+			}
+		}
+	}
+}
+
+// out[f] += in[f] for f in [0, n[
+static inline void addTo(float* out, const float* in, int n) {
+	int f = 0;
+#if defined(__AVX512F__)
+	for (; f + 16 <= n; f += 16) {
+		_mm512_storeu_ps(out + f, _mm512_add_ps(_mm512_loadu_ps(out + f), _mm512_loadu_ps(in + f)));
+	}
+#endif
+#if defined(__AVX__)
+	for (; f + 8 <= n; f += 8) {
+		_mm256_storeu_ps(out + f, _mm256_add_ps(_mm256_loadu_ps(out + f), _mm256_loadu_ps(in + f)));
+	}
+#elif defined(__SSE__)
+	for (; f + 4 <= n; f += 4) {
+		_mm_storeu_ps(out + f, _mm_add_ps(_mm_loadu_ps(out + f), _mm_loadu_ps(in + f)));
+	}
+#endif
+	for (; f < n; f++) out[f] += in[f];
+}
+
+// Copy n samples from x to every STRIDE-th float of y, returns whether any of
+// them is not 0. The test ORs the bits of all samples but the sign, so the
+// loop has no branches.
+template <int STRIDE = 1>
+static inline bool copySamples(float* y, const float* x, int n) {
+	uint32_t bits = 0;
+	for (int f = 0; f < n; f++) {
+		uint32_t u;
+		memcpy(&u, x + f, sizeof(u));
+		bits |= u;
+		y[f * STRIDE] = x[f];
+	}
+	return (bits & 0x7fffffff) != 0;
+}
+
+// Filters of the biquad kernels, one per float of a vector (two vectors with
+// SSE, whose vectors are short)
+#if defined(__AVX512F__)
+static const int BIQUAD_LANES = 16;
+#else
+static const int BIQUAD_LANES = 8;
+#endif
+
+// Transposed direct form II biquads over n interleaved frames, one filter per
+// lane: x[f * BIQUAD_LANES + j] is frame f of filter j, filtered in place.
+// coefficient holds b0, b1, b2, a1 and a2 of all lanes, state z1 and z2,
+// and both are updated. With RAMP the coefficients advance by step every
+// frame. All arrays are aligned to BIQUAD_LANES floats.
+template <bool RAMP>
+static inline void biquads(float* x, int n, float* coefficient, const float* step, float* state) {
+	const int L = BIQUAD_LANES;
+	enum { B0, B1, B2, A1, A2, COEFFICIENTS };
+#if defined(__AVX512F__)
+	__m512 c[COEFFICIENTS], s[COEFFICIENTS];
+	for (int i = 0; i < COEFFICIENTS; i++) {
+		c[i] = _mm512_load_ps(coefficient + i * L);
+		s[i] = _mm512_load_ps(step + i * L);
+	}
+	__m512 s1 = _mm512_load_ps(state);
+	__m512 s2 = _mm512_load_ps(state + L);
+	for (int f = 0; f < n; f++) {
+		__m512 in = _mm512_load_ps(x + f * L);
+		__m512 out = _mm512_add_ps(_mm512_mul_ps(c[B0], in), s1);
+		s1 = _mm512_add_ps(_mm512_sub_ps(_mm512_mul_ps(c[B1], in), _mm512_mul_ps(c[A1], out)), s2);
+		s2 = _mm512_sub_ps(_mm512_mul_ps(c[B2], in), _mm512_mul_ps(c[A2], out));
+		_mm512_store_ps(x + f * L, out);
+		for (int i = 0; RAMP && i < COEFFICIENTS; i++) c[i] = _mm512_add_ps(c[i], s[i]);
+	}
+	for (int i = 0; RAMP && i < COEFFICIENTS; i++) _mm512_store_ps(coefficient + i * L, c[i]);
+	_mm512_store_ps(state, s1);
+	_mm512_store_ps(state + L, s2);
+#elif defined(__AVX__)
+	__m256 c[COEFFICIENTS], s[COEFFICIENTS];
+	for (int i = 0; i < COEFFICIENTS; i++) {
+		c[i] = _mm256_load_ps(coefficient + i * L);
+		s[i] = _mm256_load_ps(step + i * L);
+	}
+	__m256 s1 = _mm256_load_ps(state);
+	__m256 s2 = _mm256_load_ps(state + L);
+	for (int f = 0; f < n; f++) {
+		__m256 in = _mm256_load_ps(x + f * L);
+		__m256 out = _mm256_add_ps(_mm256_mul_ps(c[B0], in), s1);
+		s1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(c[B1], in), _mm256_mul_ps(c[A1], out)), s2);
+		s2 = _mm256_sub_ps(_mm256_mul_ps(c[B2], in), _mm256_mul_ps(c[A2], out));
+		_mm256_store_ps(x + f * L, out);
+		for (int i = 0; RAMP && i < COEFFICIENTS; i++) c[i] = _mm256_add_ps(c[i], s[i]);
+	}
+	for (int i = 0; RAMP && i < COEFFICIENTS; i++) _mm256_store_ps(coefficient + i * L, c[i]);
+	_mm256_store_ps(state, s1);
+	_mm256_store_ps(state + L, s2);
+#elif defined(__SSE__)
+	// The lanes as two halves, whose recursions overlap
+	__m128 c[COEFFICIENTS][2], s[COEFFICIENTS][2], s1[2], s2[2];
+	for (int h = 0; h < 2; h++) {
+		for (int i = 0; i < COEFFICIENTS; i++) {
+			c[i][h] = _mm_load_ps(coefficient + i * L + 4 * h);
+			s[i][h] = _mm_load_ps(step + i * L + 4 * h);
+		}
+		s1[h] = _mm_load_ps(state + 4 * h);
+		s2[h] = _mm_load_ps(state + L + 4 * h);
+	}
+	for (int f = 0; f < n; f++) {
+		for (int h = 0; h < 2; h++) {
+			__m128 in = _mm_load_ps(x + f * L + 4 * h);
+			__m128 out = _mm_add_ps(_mm_mul_ps(c[B0][h], in), s1[h]);
+			s1[h] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(c[B1][h], in), _mm_mul_ps(c[A1][h], out)), s2[h]);
+			s2[h] = _mm_sub_ps(_mm_mul_ps(c[B2][h], in), _mm_mul_ps(c[A2][h], out));
+			_mm_store_ps(x + f * L + 4 * h, out);
+			for (int i = 0; RAMP && i < COEFFICIENTS; i++) c[i][h] = _mm_add_ps(c[i][h], s[i][h]);
+		}
+	}
+	for (int h = 0; h < 2; h++) {
+		for (int i = 0; RAMP && i < COEFFICIENTS; i++) _mm_store_ps(coefficient + i * L + 4 * h, c[i][h]);
+		_mm_store_ps(state + 4 * h, s1[h]);
+		_mm_store_ps(state + L + 4 * h, s2[h]);
+	}
+#else
+	// Lanes innermost, which the compiler can vectorize (NEON)
+	float* s1 = state;
+	float* s2 = state + L;
+	for (int f = 0; f < n; f++) {
+		float* y = x + f * L;
+		for (int j = 0; j < L; j++) {
+			float in = y[j];
+			float out = coefficient[B0 * L + j] * in + s1[j];
+			s1[j] = coefficient[B1 * L + j] * in - coefficient[A1 * L + j] * out + s2[j];
+			s2[j] = coefficient[B2 * L + j] * in - coefficient[A2 * L + j] * out;
+			y[j] = out;
+		}
+		for (int i = 0; RAMP && i < COEFFICIENTS * L; i++) coefficient[i] += step[i];
+	}
+#endif
+}
+
+// The kernels of one instruction set, for reads with STRIDE 1, see
+// dispatch.hpp. The arrays are indexed by RAMP.
+struct Kernels {
+	const char* name;
+	int biquadLanes;
+	bool (*copySamples)(float* y, const float* x, int n);
+	void (*mixStereo)(float* out0, float* out1, const float* in0, const float* in1,
+		float gain0, float gain1, int n);
+	void (*mixStereoRamp)(float* out0, float* out1, const float* in0, const float* in1,
+		float gain0, float step0, float gain1, float step1, int n);
+	void (*mixStereoInterpolated)(float* out0, float* out1, const float* in0, const float* in1,
+		float frac0, float frac1, float gain0, float gain1, int n);
+	void (*mixStereoFir4)(float* out0, float* out1, const float* in0, const float* in1,
+		const float* coef0, const float* coef1, float gain0, float gain1, int n);
+	void (*mixStereoFir16)(float* out0, float* out1, const float* in0, const float* in1,
+		const float* coef0, const float* coef1, float gain0, float gain1, int n);
+	void (*mixTaps6[2])(float* out, const float* const* in, const float* gain, const float* step, int n);
+	void (*mixTaps12[2])(float* out, const float* const* in, const float* gain, const float* step, int n);
+	void (*mixMatrix[2])(float* const* out, int outputs, const float* const* in, const float* gain,
+		const float* step, int inputs, int n);
+	void (*addTo)(float* out, const float* in, int n);
+	void (*biquads[2])(float* x, int n, float* coefficient, const float* step, float* state);
+};
+
+// The kernels of this translation unit
+static constexpr Kernels localKernels() {
+	return {
+		KERNELS_NAME,
+		BIQUAD_LANES,
+		&copySamples<1>,
+		&mixStereo<1>,
+		&mixStereoRamp<1>,
+		&mixStereoInterpolated<1>,
+		&mixStereoFir<4, 1>,
+		&mixStereoFir<16, 1>,
+		{ &mixTapsFixed<false, 6>, &mixTapsFixed<true, 6> },
+		{ &mixTapsFixed<false, 12>, &mixTapsFixed<true, 12> },
+		{ &mixMatrix<false>, &mixMatrix<true> },
+		&addTo,
+		{ &biquads<false>, &biquads<true> }
+	};
+}
@@ -0,0 +1,176 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "pan.hpp"
+#include <lvtk/plugin.hpp>
+#include <lv2/atom/atom.h>
+#include <lv2/atom/util.h>
+#include <lv2/buf-size/buf-size.h>
+#include <lv2/options/options.h>
+#include <lv2/patch/patch.h>
+#include <lv2/urid/urid.h>
+
+#define PAN_URI "http://github.com/brainstar/lv2/pan"
+
+// Parameters shared by all sizes, in the order of enum Parameter
+static const char* const PARAMETER_URIS[PARAMETERS] = {
+	PAN_URI "#radius",
+	PAN_URI "#pdist",
+	PAN_URI "#edist",
+	PAN_URI "#alpha",
+	PAN_URI "#window",
+	PAN_URI "#relative_mode"
+};
+
+template <int N, int L = 1>
+class PanPlugin : public Pan<N, L>, public lvtk::Plugin<PanPlugin<N, L>> {
+public:
+	PanPlugin(const lvtk::Args &args) : lvtk::Plugin<PanPlugin<N, L>>(args) {
+		this->sample_rate = static_cast<float> (args.sample_rate);
+
+		// Without urid:map the event port and the options are ignored
+		const LV2_Options_Option* options = nullptr;
+		for (const auto& feature : args.features) {
+			if (!strcmp(feature.URI, LV2_URID__map)) map = (LV2_URID_Map*) feature.data;
+			else if (!strcmp(feature.URI, LV2_OPTIONS__options)) options = (const LV2_Options_Option*) feature.data;
+			else if (!strcmp(feature.URI, LV2_BUF_SIZE__fixedBlockLength)) this->blockLengths.fixed = true;
+			else if (!strcmp(feature.URI, LV2_BUF_SIZE__powerOf2BlockLength)) this->blockLengths.powerOf2 = true;
+		}
+		if (map && options) readBlockLengths(options);
+
+		this->init((int) args.sample_rate);
+
+		if (map) {
+			atomObject = map->map(map->handle, LV2_ATOM__Object);
+			atomBlank = map->map(map->handle, LV2_ATOM__Blank);
+			atomURID = map->map(map->handle, LV2_ATOM__URID);
+			atomFloat = map->map(map->handle, LV2_ATOM__Float);
+			atomDouble = map->map(map->handle, LV2_ATOM__Double);
+			atomInt = map->map(map->handle, LV2_ATOM__Int);
+			atomBool = map->map(map->handle, LV2_ATOM__Bool);
+			patchSet = map->map(map->handle, LV2_PATCH__Set);
+			patchProperty = map->map(map->handle, LV2_PATCH__property);
+			patchValue = map->map(map->handle, LV2_PATCH__value);
+			for (int p = 0; p < PARAMETERS; p++) parameters[p] = map->map(map->handle, PARAMETER_URIS[p]);
+		}
+	}
+
+	~PanPlugin() { }
+
+	void connect_port(uint32_t port, void* data) {
+		if (port == 16 + N) events = (const LV2_Atom_Sequence*) data;
+		else this->connect_portBase(port, data);
+	}
+
+	void activate() {
+		this->activateBase();
+	}
+
+	void deactivate() {
+		this->deactivateBase();
+	}
+
+	// Process the block in parts between the parameter changes, so that every
+	// change takes effect on the frame of its event
+	void run(uint32_t nframes) {
+		this->beginRun();
+
+		uint32_t done = 0;
+		if (events && map) {
+			LV2_ATOM_SEQUENCE_FOREACH(events, event) {
+				int parameter;
+				float value;
+				if (!parameterChange(&event->body, parameter, value)) continue;
+
+				// Clamped to [done, nframes] before narrowing: negative or out of
+				// order times take effect at once, late ones at the end
+				int64_t time = event->time.frames;
+				uint32_t frame = (time < done) ? done : (time > nframes) ? nframes : (uint32_t) time;
+				if (frame > done) {
+					this->runFrames(done, frame - done);
+					done = frame;
+				}
+				this->setParameter(parameter, value);
+			}
+		}
+		this->runFrames(done, nframes - done);
+
+		this->endRun(nframes);
+	}
+
+private:
+	// Block lengths from the buf-size options of the host
+	void readBlockLengths(const LV2_Options_Option* options) {
+		LV2_URID atomInt = map->map(map->handle, LV2_ATOM__Int);
+		LV2_URID minimum = map->map(map->handle, LV2_BUF_SIZE__minBlockLength);
+		LV2_URID nominal = map->map(map->handle, LV2_BUF_SIZE__nominalBlockLength);
+		LV2_URID maximum = map->map(map->handle, LV2_BUF_SIZE__maxBlockLength);
+		for (const LV2_Options_Option* option = options; option->key; option++) {
+			if (option->type != atomInt || option->size != sizeof(int32_t)) continue;
+			int32_t value = *(const int32_t*) option->value;
+			if (value < 1) continue;
+			if (option->key == minimum) this->blockLengths.minimum = value;
+			else if (option->key == nominal) this->blockLengths.nominal = value;
+			else if (option->key == maximum) this->blockLengths.maximum = value;
+		}
+	}
+
+	// Decode a patch:Set of one of our parameters
+	bool parameterChange(const LV2_Atom* atom, int& parameter, float& value) {
+		if (atom->type != atomObject && atom->type != atomBlank) return false;
+		const LV2_Atom_Object* object = (const LV2_Atom_Object*) atom;
+		if (object->body.otype != patchSet) return false;
+
+		const LV2_Atom* property = nullptr;
+		const LV2_Atom* data = nullptr;
+		lv2_atom_object_get(object, patchProperty, &property, patchValue, &data, 0);
+		if (!property || property->type != atomURID || !data) return false;
+
+		LV2_URID key = ((const LV2_Atom_URID*) property)->body;
+		for (parameter = 0; parameter < PARAMETERS && parameters[parameter] != key; parameter++);
+		if (parameter == PARAMETERS) return false;
+
+		if (data->type == atomFloat) value = ((const LV2_Atom_Float*) data)->body;
+		else if (data->type == atomDouble) value = ((const LV2_Atom_Double*) data)->body;
+		else if (data->type == atomInt) value = ((const LV2_Atom_Int*) data)->body;
+		else if (data->type == atomBool) value = ((const LV2_Atom_Bool*) data)->body ? 1.f : 0.f;
+		else return false;
+		return true;
+	}
+
+	const LV2_Atom_Sequence* events = nullptr;
+	LV2_URID_Map* map = nullptr;
+	LV2_URID atomObject, atomBlank, atomURID, atomFloat, atomDouble, atomInt, atomBool;
+	LV2_URID patchSet, patchProperty, patchValue;
+	LV2_URID parameters[PARAMETERS];
+};
+
+// All sizes share this binary, see manifest.ttl. Keep in sync with SIZES in the Makefile.
+static const lvtk::Descriptor<PanPlugin<2>> pan2 (PAN_URI "2");
+static const lvtk::Descriptor<PanPlugin<4>> pan4 (PAN_URI "4");
+static const lvtk::Descriptor<PanPlugin<5>> pan5 (PAN_URI "5");
+static const lvtk::Descriptor<PanPlugin<8>> pan8 (PAN_URI "8");
+static const lvtk::Descriptor<PanPlugin<9>> pan9 (PAN_URI "9");
+static const lvtk::Descriptor<PanPlugin<12>> pan12 (PAN_URI "12");
+static const lvtk::Descriptor<PanPlugin<16>> pan16 (PAN_URI "16");
+static const lvtk::Descriptor<PanPlugin<24>> pan24 (PAN_URI "24");
+static const lvtk::Descriptor<PanPlugin<32>> pan32 (PAN_URI "32");
+static const lvtk::Descriptor<PanPlugin<64>> pan64 (PAN_URI "64");
+static const lvtk::Descriptor<PanPlugin<128>> pan128 (PAN_URI "128");
+// Monitor mixes: N channels heard by L listeners
+static const lvtk::Descriptor<PanPlugin<9, 3>> pan9x3 (PAN_URI "9x3");
+static const lvtk::Descriptor<PanPlugin<16, 3>> pan16x3 (PAN_URI "16x3");
@@ -15,95 +15,241 @@
  * For a full copy of the GNU General Public License see the LICENSE file.
  */
  
+#if defined(__SSE__)
 //To enable DAZ
 #include <pmmintrin.h>
 //To enable FTZ
 #include <xmmintrin.h>
+#endif
+#include <array>
 #include <cstdint>
 #include <math.h>
+#include <string.h>
+#include <time.h>
+#include "airabsorption.hpp"
+#include "arena.hpp"
+#include "convolution.hpp"
+#include "delayline.hpp"
+#include "geometry.hpp"
+#include "headfilters.hpp"
+#include "interpolation.hpp"
+#include "dispatch.hpp"
+#include "surround.hpp"
 #include "triangularaverage.hpp"
+#include "workers.hpp"
 
+// Channels per tile of the delay line, see delayline.hpp. The mix reads
+// every channel as one span, which is fastest with one row per channel on
+// all channel counts measured with pan-bench. Build with e.g.
+// -DPAN_DELAY_TILE=4 to interleave the frames of 4 channels instead.
+#ifndef PAN_DELAY_TILE
+#define PAN_DELAY_TILE 1
+#endif
+
+// Parameters that can be set both by their control port and by events,
+// values are the port indices
+enum Parameter {
+	PARAMETER_RADIUS = 0,
+	PARAMETER_PLAYER_DIST = 1,
+	PARAMETER_EAR_DIST = 2,
+	PARAMETER_ALPHA0 = 3,
+	PARAMETER_WINDOW = 4,
+	PARAMETER_RELATIVE_DELAYS = 5,
+	PARAMETERS = 6
+};
+
+// Ways to reach a new delay, values of the delay mode control port
+enum DelayMode {
+	// Glide through the fractional delays of the smoother (doppler)
+	DELAY_GLIDE = 0,
+	// Crossfade between the old and the new integer delay
+	DELAY_CROSSFADE = 1
+};
+
+// Block lengths the host promises (LV2 buf-size extension), 0 if unknown.
+// With fixed, every block is maximum frames long, with powerOf2 every block
+// length is a power of two.
+struct BlockLengths {
+	int minimum = 0;
+	int nominal = 0;
+	int maximum = 0;
+	bool fixed = false;
+	bool powerOf2 = false;
+
+	// Whether every block is a whole multiple of n frames
+	bool multipleOf(int n) const {
+		int length = maximum ? maximum : nominal;
+		return (fixed && length > 0 && length % n == 0) || (powerOf2 && minimum >= n);
+	}
+};
+
+// CHANNELS is the number of sound sources. It is a template parameter, so
+// that all per-channel loops have a constant trip count and all per-channel
+// data lives in fixed size arrays.
+// LISTENERS is the number of listeners, each with its own ears, delays and
+// output pair. They all read the same delay line: every source is buffered
+// once, however many listeners hear it. The delays, gains and smoothers are
+// kept per voice, voice v is source v % CHANNELS heard by listener
+// v / CHANNELS. Listener 0 is at the center facing front, the others are
+// placed by their ports.
+template <int CHANNELS, int LISTENERS = 1>
 class Pan {
 public:
+	static const int VOICES = CHANNELS * LISTENERS;
+
 	Pan() {
+#if defined(__SSE__)
 		_MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
 		_MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+#endif
+		kernels = &chosenKernels();
 	}
 
 	~Pan() {
-		for (int i = 0; i < 2; i++) {
-			delete[] avg[i];
-			delete[] attenuation[i];
-			delete[] delay[i];
-			delete[] dist[i];
+		workers.stop();
+	}
+
+	void init(int srate) {
+		// Longest path from the port ranges of the ttl files: the farthest
+		// source, half the widest ear distance, a further listener at a
+		// corner of its range and the image sources of the room, which are at
+		// most ROOM_MAX farther than their source
+		double longestPath = MAX_DISTANCE + MAX_EAR_DISTANCE / 2 + (LISTENERS > 1 ? LISTENER_RANGE * M_SQRT2 : 0.0) + ROOM_MAX;
+		// Blocks are processed in parts of at most blockLimit frames, the
+		// longest block of the host if it is known
+		blockLimit = MAX_BLOCK;
+		if (blockLengths.maximum > 0 && blockLengths.maximum < MAX_BLOCK) blockLimit = blockLengths.maximum;
+		// The delay line holds the longest delay in whole samples, one
+		// block and the interpolation taps
+		int longestDelay = ceil(longestPath / v_air * sample_rate);
+		int ringSize = longestDelay + blockLimit + INTERPOLATION_TAPS;
+		int guardSize = blockLimit + INTERPOLATION_TAPS;
+
+		// Large ensembles mix groups of voices in parallel
+		groups = 1;
+		if (VOICES >= PARALLEL_CHANNELS) {
+			groups = VOICES / GROUP_CHANNELS;
+			if (groups > MAX_GROUPS) groups = MAX_GROUPS;
+			int threads = WorkerPool::available();
+			if (maxThreads > 0 && maxThreads < threads) threads = maxThreads;
+			if (groups > threads) groups = threads;
+			if (groups < 1) groups = 1;
 		}
 
-		for (int ch = 0; ch < CHANNELS; ch++) {
-			delete[] inputBuffer[ch];
+		// Batches of 8 frames fill the vectors of the kernels. If every
+		// block is a multiple of 8 frames, each block starts a batch.
+		// Otherwise the batch divides the sample rate, so that the window
+		// holds whole batches. At high sample rates the batches grow, so that
+		// the smoothers keep at most MAX_HISTORY batches of their input. A
+		// part pushes the batches that start within it before reading them.
+		avgBatchSize = 8;
+		if (!blockLengths.multipleOf(avgBatchSize)) {
+			while (srate % avgBatchSize != 0) avgBatchSize /= 2;
 		}
-		
-		delete[] delayBuffer;
-		delete[] avg;
-		delete[] attenuation;
-		delete[] delay;
-		delete[] dist;
-		delete[] inputBuffer;
-	}
+		while ((2 * srate) / avgBatchSize > MAX_HISTORY) avgBatchSize *= 2;
+		int batches = (2 * srate) / avgBatchSize;
+		int batchesAhead = blockLimit / avgBatchSize + 1;
 
-	void init(int srate) {
-		// Take values from ttl file
-		// Max. signal path: max. radius + max. ear distance
-		// Max. dealy = max. sig. path / v_air
-		// Max. sample delay = max. delay / duration of single sample
-		// Buffer size > max. sample delay
-		// Here: double of max. sample delay
-		BUFFER_SIZE = ((20.0 + 1.0) / v_air) / (1.0 / sample_rate) * 2;
+		// All buffers of the instance in one arena, zeroed and mapped here
+		// and not in the audio thread
+		int partitions = HeadFilters::partitions(sample_rate);
+		size_t bytes = DelayLine<CHANNELS, DELAY_TILE>::bytes(ringSize, guardSize)
+			+ 2 * VOICES * TriangularAverage::bytes(batches, batchesAhead)
+			+ HeadFilters::bytes(sample_rate)
+			+ 2 * VOICES * Convolution::Input::bytes(partitions)
+			+ Arena::bytes<float>(2 * VOICES * VOICE_BLOCK)
+			+ Arena::bytes<float>((groups - 1) * LISTENERS * 2 * blockLimit);
+		arena.allocate(bytes);
+		inputBuffer.init(ringSize, guardSize, arena, *kernels);
 		r_target = 5.;
 		pdist_target = 1.;
 		edist_target = 0.149;
 		a0_target = 0.f;
 		v_air = 343.2;
 
-		avgBatchSize = 8;
-		int batches;
-		while (srate % avgBatchSize != 0) avgBatchSize /= 2;
-		batches = (2 * srate) / avgBatchSize;
-
-		delay = new int*[2];
-		attenuation = new float*[2];
-		avg = new TriangularAverage*[2];
-		dist = new double*[2];
-
 		for (int i = 0; i < 2; i++) {
-			avg[i] = new TriangularAverage[CHANNELS];
-			attenuation[i] = new float[CHANNELS];
-			delay[i] = new int[CHANNELS];
-			dist[i] = new double[CHANNELS];
-
-			for (int j = 0; j < CHANNELS; j++) {
-				avg[i][j].init(batches);
+			for (int j = 0; j < VOICES; j++) {
+				avg[i][j].init(batches, batchesAhead, arena);
 				avg[i][j].setWindowSize(batches / 2);
 				attenuation[i][j] = 1.f;
 				delay[i][j] = 0;
 			}
 		}
 
-		input = new float*[CHANNELS];
-		inputBuffer = new float*[CHANNELS];
-		delayBuffer = new float[CHANNELS];
 		for (int ch = 0; ch < CHANNELS; ch++) {
 			input[ch] = nullptr;
-			delayBuffer[ch] = 0.f;
-			inputBuffer[ch] = new float[BUFFER_SIZE];
-			for (int i = 0; i < BUFFER_SIZE; i++) {
-				inputBuffer[ch][i] = 0.f;
+			source_azimuth[ch] = nullptr;
+			source_distance[ch] = nullptr;
+			// The first run takes over the connected source ports
+			azimuthValue[ch] = distanceValue[ch] = NAN;
+		}
+		for (int l = 0; l < LISTENERS; l++) {
+			listener_x[l] = listener_y[l] = listener_heading[l] = nullptr;
+		}
+
+		// Build the shared interpolation tables here and not in the audio thread
+		lagrangeTable();
+		sincTable();
+		interpolationMode = INTERPOLATION_LINEAR;
+
+		for (int l = 0; l < LISTENERS; l++) geometry[l].init(sample_rate, v_air);
+
+		headFilters.init(convolution, sample_rate, v_air, arena);
+		for (int e = 0; e < 2; e++) {
+			for (int v = 0; v < VOICES; v++) {
+				convInput[e][v].init(partitions, arena);
+				filterIndex[e][v] = filterShown[e][v] = 0;
+			}
+		}
+		binauralMode = binaural_target = false;
+		convWritten = false;
+		cleanBinaural();
+
+		air.init(sample_rate, *kernels);
+		airMode = air_target = false;
+
+		outputFormat = format_target = OUTPUT_STEREO;
+		speakerCount = speakers_target = 8;
+		for (int ch = 0; ch < CHANNELS; ch++) {
+			encoding[ch].fill(0.f);
+			encodingTarget[ch].fill(0.f);
+			encodingStep[ch].fill(0.f);
+		}
+		encodingPosition = encodingLength = 0;
+		voiced = arena.take<float>(2 * VOICES * VOICE_BLOCK);
+
+		for (int e = 0; e < 2; e++) {
+			for (int v = 0; v < VOICES; v++) {
+				for (int w = 0; w < WALLS; w++) {
+					taps.delay[e][v][w] = 0;
+					taps.gain[e][v][w] = 0.f;
+				}
 			}
 		}
+		tapsFrom = tapsTarget = taps;
+		tapFadePosition = tapFadeLength = 0;
+		tapsAudible = false;
+
+		if (groups > 1) {
+			// Partial stereo sums per listener of all groups but the first,
+			// which mixes into the outputs
+			partial = arena.take<float>((groups - 1) * LISTENERS * 2 * blockLimit);
+			workers.start(groups - 1, &Pan::mixGroup, this);
+		}
 		
-		generalBufferPointer = 0;
-		timer = 0;
+		// Same values as the targets, so that the first run applies the ports
+		parameter = { r_target, pdist_target, edist_target, a0_target, window_target, rel_delay_target };
+		portValue = parameter;
+
+		layoutMode = layout_target = LAYOUT_ARC;
+		sourcesMoved = false;
+		delayMode = delay_mode_target = DELAY_GLIDE;
+		fadeFrames = FADE_TIME * sample_rate;
+
 		timerOverrun = (batches / 2 + 2) * avgBatchSize;
-		useAverage = true;
+		smoothAll();
+		minDelay = maxDelay = 0;
+		loadAverage = loadPeak = 0.f;
 	}
 	
 	void connect_portBase(uint32_t port, void* data) {
@@ -134,255 +280,1185 @@ public:
 		else if (port >= 8 && port < (8 + CHANNELS)) {
 			input[port - 8] = (float*) data;
 		}
+		else if (port == 8 + CHANNELS) {
+			interpolation = (float*) data;
+		}
+		// Optional telemetry outputs, see report()
+		else if (port == 9 + CHANNELS) {
+			load = (float*) data;
+		}
+		else if (port == 10 + CHANNELS) {
+			load_peak = (float*) data;
+		}
+		else if (port == 11 + CHANNELS) {
+			smoothing = (float*) data;
+		}
+		else if (port == 12 + CHANNELS) {
+			smoothing_left = (float*) data;
+		}
+		else if (port == 13 + CHANNELS) {
+			min_delay = (float*) data;
+		}
+		else if (port == 14 + CHANNELS) {
+			max_delay = (float*) data;
+		}
+		else if (port == 15 + CHANNELS) {
+			headroom = (float*) data;
+		}
+		// 16 + CHANNELS is the event port of the plugin, see pan.cpp
+		else if (port == 17 + CHANNELS) {
+			layout = (float*) data;
+		}
+		else if (port >= 18 + CHANNELS && port < 18 + 3 * CHANNELS) {
+			int ch = (port - 18 - CHANNELS) / 2;
+			if ((port - 18 - CHANNELS) % 2 == 0) source_azimuth[ch] = (float*) data;
+			else source_distance[ch] = (float*) data;
+		}
+		else if (port == 18 + 3 * CHANNELS) {
+			delay_mode = (float*) data;
+		}
+		else if (port == 19 + 3 * CHANNELS) {
+			fade_time = (float*) data;
+		}
+		// Output pair and position of every further listener
+		else if (port >= 20 + 3 * CHANNELS && port < 20 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			int l = (port - 20 - 3 * CHANNELS) / LISTENER_PORTS + 1;
+			int p = (port - 20 - 3 * CHANNELS) % LISTENER_PORTS;
+			if (p < 2) output[2 * l + p] = (float*) data;
+			else if (p == 2) listener_x[l] = (float*) data;
+			else if (p == 3) listener_y[l] = (float*) data;
+			else listener_heading[l] = (float*) data;
+		}
+		else if (port == 20 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			binaural = (float*) data;
+		}
+		else if (port == 21 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			latency = (float*) data;
+		}
+		else if (port == 22 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			early_reflections = (float*) data;
+		}
+		else if (port == 23 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			room_width = (float*) data;
+		}
+		else if (port == 24 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			room_depth = (float*) data;
+		}
+		else if (port == 25 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			room_height = (float*) data;
+		}
+		else if (port == 26 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			absorption = (float*) data;
+		}
+		else if (port == 27 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			air_absorption = (float*) data;
+		}
+		else if (port == 28 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			output_format = (float*) data;
+		}
+		else if (port == 29 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)) {
+			speakers = (float*) data;
+		}
+		else if (port >= 30 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1)
+			&& port < 30 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1) + Surround::OUTPUTS) {
+			surround[port - (30 + 3 * CHANNELS + LISTENER_PORTS * (LISTENERS - 1))] = (float*) data;
+		}
 	}
 
 	void activateBase() {
 		// Clean buffer
-		for (int j = 0; j < CHANNELS; j++) {
-			for (int i = 0; i < BUFFER_SIZE; i++) {
-				inputBuffer[j][i] = 0;
-			}
+		inputBuffer.clean();
+		for (int j = 0; j < VOICES; j++) {
 			for (int i = 0; i < 2; i++) {
 				avg[i][j].clean();
 			}
 		}
-		generalBufferPointer = 0;
-		timer = 0;
-		useAverage = true;
+		smoothAll();
+		cleanBinaural();
+		loadAverage = loadPeak = 0.f;
 	} 
 
+	// Put all channels on the smoothing path, with a smoother that starts at 0.
+	// Crossfades jump to the delays instead.
+	void smoothAll() {
+		for (int v = 0; v < VOICES; v++) {
+			moving[v] = (delayMode == DELAY_GLIDE);
+			timer[v] = 0;
+			smoothDelay[0][v] = smoothDelay[1][v] = 0.f;
+		}
+		useAverage = (delayMode == DELAY_GLIDE);
+		batchPhase = 0;
+	}
+
 	void deactivateBase() {
 	}
 
-	float getInputValue(int ch, int offset) {
-		// Transform relative offset -> position in array
-		offset += generalBufferPointer;
+	// Mix the voices of one group into the outputs (group 0) or into its
+	// partial sums. A group may span several listeners, each gets its voices.
+	static void mixGroup(void* context, int group) {
+		Pan* pan = (Pan*) context;
+		int first = group * VOICES / pan->groups;
+		int last = (group + 1) * VOICES / pan->groups;
+		if (pan->voicesApart()) {
+			pan->mixVoices(first, last);
+			return;
+		}
+		if (group == 0) {
+			// The reduction only adds to the listeners of the other groups
+			for (int l = 0; l < LISTENERS; l++) {
+				memset(pan->output[2 * l] + pan->blockOffset, 0, pan->blockFrames * sizeof(float));
+				memset(pan->output[2 * l + 1] + pan->blockOffset, 0, pan->blockFrames * sizeof(float));
+			}
+		}
 
-		// Scale into correct values
-		while (offset < 0) offset += BUFFER_SIZE;
-		while (offset >= BUFFER_SIZE) offset -= BUFFER_SIZE;
+		for (int l = first / CHANNELS; l * CHANNELS < last; l++) {
+			float* out0;
+			float* out1;
+			if (group == 0) {
+				out0 = pan->output[2 * l] + pan->blockOffset;
+				out1 = pan->output[2 * l + 1] + pan->blockOffset;
+			} else {
+				out0 = pan->sums(group, l);
+				out1 = out0 + pan->blockLimit;
+				memset(out0, 0, pan->blockFrames * sizeof(float));
+				memset(out1, 0, pan->blockFrames * sizeof(float));
+			}
 
-		return inputBuffer[ch][offset];
+			int begin = (first > l * CHANNELS) ? first : l * CHANNELS;
+			int end = (last < (l + 1) * CHANNELS) ? last : (l + 1) * CHANNELS;
+			pan->mixRange(out0, out1, begin, end, pan->blockFrames);
+		}
 	}
 
-	float getInterpolatedValue(int ch, float offset) {
-		float position;
-		int index1, index2;
-		float weight1, weight2;
+	// Mix the direct paths and the reflections of the voices [first, last[
+	// of one listener into out0 and out1
+	void mixRange(float* out0, float* out1, int first, int last, uint32_t nframes) {
+		if (useAverage && delayMode == DELAY_CROSSFADE) mixCrossfade(out0, out1, first, last, nframes);
+		else if (useAverage) mixInterpolated(out0, out1, first, last, nframes);
+		else mixStatic(out0, out1, first, last, nframes);
+		if (tapsAudible || tapFadeLength) mixReflections(out0, out1, first, last, nframes);
+	}
 
-		// Determine correct address in ring buffer
-		position = offset + generalBufferPointer;
-		while (position < 0) position += BUFFER_SIZE;
+	// Early reflections: every voice reads its taps of both ears at their
+	// integer delays in one pass per ear. A change of the taps fades from
+	// the old to the new taps over the crossfade time, whatever the delay
+	// mode; changes during a fade start the next fade after it.
+	void mixReflections(float* out0, float* out1, int first, int last, uint32_t nframes) {
+		uint32_t fade = 0;
+		if (tapFadeLength) fade = (tapFadeLength - tapFadePosition < nframes) ? tapFadeLength - tapFadePosition : nframes;
+		float step = tapFadeLength ? 1.f / tapFadeLength : 0.f;
+		float in = tapFadePosition * step;
 
-		// Determine corresponding indices and weights.
-		index1 = (int) position;
-		weight2 = position - (float) index1;
-		index1 %= BUFFER_SIZE;
-		index2 = (index1 + 1) % BUFFER_SIZE;
-		weight1 = 1.0 - weight2;
+		const float* reads[2 * WALLS];
+		float gains[2 * WALLS];
+		float steps[2 * WALLS];
+		for (int v = first; v < last; v++) {
+			if (inputBuffer.silent(source(v))) continue;
+			for (int e = 0; e < 2; e++) {
+				float* out = e ? out1 : out0;
+				if (fade) {
+					for (int w = 0; w < WALLS; w++) {
+						reads[w] = inputBuffer.read(source(v), -taps.delay[e][v][w]);
+						gains[w] = taps.gain[e][v][w] * in;
+						steps[w] = taps.gain[e][v][w] * step;
+						reads[WALLS + w] = inputBuffer.read(source(v), -tapsFrom.delay[e][v][w]);
+						gains[WALLS + w] = tapsFrom.gain[e][v][w] * (1.f - in);
+						steps[WALLS + w] = -tapsFrom.gain[e][v][w] * step;
+					}
+					mixTaps<true, 2 * WALLS, STRIDE>(*kernels, out, reads, gains, steps, fade);
+				}
+				if (fade < nframes) {
+					for (int w = 0; w < WALLS; w++) {
+						reads[w] = inputBuffer.read(source(v), fade - taps.delay[e][v][w]);
+						gains[w] = taps.gain[e][v][w];
+					}
+					mixTaps<false, WALLS, STRIDE>(*kernels, out + fade, reads, gains, nullptr, nframes - fade);
+				}
+			}
+		}
+	}
 
-		return inputBuffer[ch][index1] * weight1 + inputBuffer[ch][index2] * weight2;
+	// Advance the fade of the reflections by nframes frames
+	void advanceReflections(uint32_t nframes) {
+		if (!tapFadeLength) return;
+		tapFadePosition += nframes;
+		if (tapFadePosition < tapFadeLength) return;
+		tapFadeLength = 0;
+		if (!taps.same(tapsTarget)) startReflections();
 	}
 
-	void runBase(uint32_t nframes) {
-		// Update data if necessary
-		if (*window_size != window_target) {
-			window_target = *window_size;
-			for (int i = 0; i < 2; i++) {
-				for (int ch = 0; ch < CHANNELS; ch++) {
-					avg[i][ch].setWindowSize(window_target * sample_rate / avgBatchSize);
-				}
+	// Fade from the current taps to the target taps
+	void startReflections() {
+		tapsFrom = taps;
+		taps = tapsTarget;
+		tapFadePosition = 0;
+		tapFadeLength = fadeFrames;
+		tapsAudible = false;
+		for (int e = 0; e < 2; e++) {
+			for (int v = 0; v < VOICES; v++) {
+				for (int w = 0; w < WALLS; w++) tapsAudible = tapsAudible || taps.gain[e][v][w] != 0.f;
 			}
-			timer = 0;
-			timerOverrun = (avg[0][0].getWindowSize() + 2) * avgBatchSize;
-			useAverage = true;
 		}
-		if (*radius != r_target
-			|| *player_dist != pdist_target
-			|| *ear_dist != edist_target
-			|| *alpha0 != a0_target
-			|| *relative_delays != rel_delay_target) {
-			update_data(*radius, *player_dist, *ear_dist, *alpha0, *relative_delays);
-			r_target = *radius;
-			pdist_target = *player_dist;
-			edist_target = *ear_dist;
-			a0_target = *alpha0;
-			rel_delay_target = *relative_delays;
+	}
+
+	// Binaural output: every voice is mixed on its own into the current
+	// partition of the convolution inputs of both ears
+	void mixVoices(int first, int last) {
+		float* signal[2 * VOICES];
+		for (int v = first; v < last; v++) {
+			float* out0 = voice(0, v);
+			float* out1 = voice(1, v);
+			memset(out0, 0, blockFrames * sizeof(float));
+			memset(out1, 0, blockFrames * sizeof(float));
+			mixRange(out0, out1, v, v + 1, blockFrames);
+			// A silent voice is heard while its air filters ring out
+			if (!inputBuffer.silent(source(v))
+				|| (airMode && (air.ringing(2 * v) || air.ringing(2 * v + 1)))) heard[v] = true;
+			signal[2 * (v - first)] = out0;
+			signal[2 * (v - first) + 1] = out1;
 		}
+		if (airMode) air.process(signal, 2 * first, 2 * last, blockFrames);
+	}
 
-		if (useAverage) {
-			// TODO: What if nframes % batchsize != 0??? (Should not be the case, but Murphy)
-			for (int i = 0; i < CHANNELS; i++) {
-				avg[0][i].pushData(delay[0][i], nframes / avgBatchSize);
-				avg[1][i].pushData(delay[1][i], nframes / avgBatchSize);
+	// Signal of ear e of voice v in the current block when the voices are
+	// mixed on their own
+	float* voice(int e, int v) {
+		if (binauralMode) return convInput[e][v].block(convPhase);
+		return voiced + (2 * v + e) * VOICE_BLOCK;
+	}
+
+	// Whether the voices are mixed on their own, see mixVoices()
+	bool voicesApart() const {
+		return binauralMode || airMode || outputFormat != OUTPUT_STEREO;
+	}
+
+	// Outside binaural mode: sum the voices of every listener into its
+	// outputs, or encode those of the center listener to the surround
+	// outputs
+	void sumVoices(uint32_t offset, uint32_t nframes) {
+		for (int l = 0; l < LISTENERS; l++) {
+			float* out0 = output[2 * l] + offset;
+			float* out1 = output[2 * l + 1] + offset;
+			memset(out0, 0, nframes * sizeof(float));
+			memset(out1, 0, nframes * sizeof(float));
+			if (l == 0 && outputFormat != OUTPUT_STEREO) {
+				encodeVoices(offset, nframes);
+				continue;
+			}
+			for (int v = l * CHANNELS; v < (l + 1) * CHANNELS; v++) {
+				if (!heard[v]) continue;
+				kernels->addTo(out0, voice(0, v), nframes);
+				kernels->addTo(out1, voice(1, v), nframes);
+				heard[v] = false;
 			}
-			timer += nframes;
 		}
+	}
 
-		// Step 1: Buffer input
+	// Encode the heard voices of the center listener to the surround
+	// outputs with their gains, up to the end of the ramp with ramping
+	// gains and with the targets after it. Both ears of the center listener are at its center in surround
+	// formats, ear 0 is the signal of a voice.
+	void encodeVoices(uint32_t offset, uint32_t nframes) {
+		const int OUTPUTS = Surround::OUTPUTS;
+		// Only the connected outputs are encoded
+		int formatOutputs = Surround::outputs(outputFormat, speakerCount);
+		int output[OUTPUTS];
+		float* out[OUTPUTS];
+		int outputs = 0;
+		for (int o = 0; o < formatOutputs; o++) {
+			if (surround[o]) {
+				output[outputs] = o;
+				out[outputs++] = surround[o] + offset;
+			}
+		}
+
+		uint32_t left = encodingLength - encodingPosition;
+		uint32_t ramped = (left < nframes) ? left : nframes;
+		int heardChannel[CHANNELS];
+		const float* in[CHANNELS];
+		float gain[CHANNELS * OUTPUTS];
+		float step[CHANNELS * OUTPUTS];
+		int inputs = 0;
 		for (int ch = 0; ch < CHANNELS; ch++) {
-			// Is there an overflow?
-			if (generalBufferPointer + nframes <= BUFFER_SIZE) {
-				// If not: simply copy all the elements
-				for (int i = 0; i < nframes; i++) inputBuffer[ch][generalBufferPointer + i] = input[ch][i];
-			} else {
-				int sizeLeft = BUFFER_SIZE - generalBufferPointer;
-				for (int i = 0; i < sizeLeft; i++) inputBuffer[ch][generalBufferPointer + i] = input[ch][i];
-				int framesLeft = nframes - sizeLeft;
-				for (int i = 0; i < framesLeft; i++) inputBuffer[ch][i] = input[ch][sizeLeft + i];
+			if (heard[ch]) {
+				heardChannel[inputs] = ch;
+				in[inputs] = voice(0, ch);
+				for (int o = 0; o < outputs; o++) {
+					gain[inputs * outputs + o] = encodingGain(ch, output[o]);
+					step[inputs * outputs + o] = encodingStep[ch][output[o]];
+				}
+				inputs++;
 			}
+			heard[ch] = false;
 		}
+		if (!outputs) return;
+		if (ramped) kernels->mixMatrix[true](out, outputs, in, gain, step, inputs, ramped);
+		if (ramped == nframes) return;
 
-		// Step 2: Output
-		int batches;
-		float value;
-		if (!useAverage) {
-			for (int i = 0; i < 2; i++) {
-				for (int f = 0; f < nframes; f++) {
-					value = 0.f;
-					// Get every frame from the right buffer
-					for (int ch = 0; ch < CHANNELS; ch++) {
-						value += (getInputValue(ch, f - delay[i][ch]) * attenuation[i][ch]);
+		// The rest of the part at the targets
+		for (int o = 0; o < outputs; o++) out[o] += ramped;
+		for (int i = 0; i < inputs; i++) {
+			in[i] += ramped;
+			for (int o = 0; o < outputs; o++) gain[i * outputs + o] = encodingTarget[heardChannel[i]][output[o]];
+		}
+		kernels->mixMatrix[false](out, outputs, in, gain, nullptr, inputs, nframes - ramped);
+	}
+
+	// Gain of channel ch on surround output o at the current position of
+	// the ramp
+	float encodingGain(int ch, int o) const {
+		return encodingLength ? encoding[ch][o] + encodingPosition * encodingStep[ch][o] : encoding[ch][o];
+	}
+
+	// Ramp the gains of all channels from where they are to their targets
+	// over the crossfade time
+	void startEncoding() {
+		for (int ch = 0; ch < CHANNELS; ch++) {
+			for (int o = 0; o < Surround::OUTPUTS; o++) {
+				encoding[ch][o] = encodingGain(ch, o);
+				encodingStep[ch][o] = (encodingTarget[ch][o] - encoding[ch][o]) / fadeFrames;
+			}
+		}
+		encodingPosition = 0;
+		encodingLength = fadeFrames;
+	}
+
+	// Advance the ramp of the encoding gains by nframes frames
+	void advanceEncoding(uint32_t nframes) {
+		if (!encodingLength) return;
+		encodingPosition += nframes;
+		if (encodingPosition < encodingLength) return;
+		encoding = encodingTarget;
+		encodingPosition = encodingLength = 0;
+	}
+
+	// Copy the filtered previous partition to the outputs and filter the
+	// current partition once it is complete. The voices of a listener are
+	// summed in the frequency domain, one inverse transform per ear. Voices
+	// whose filter changed are heard through the old and the new filter,
+	// crossfaded over the partition.
+	void filterVoices(uint32_t offset, uint32_t nframes) {
+		const int BLOCK = Convolution::BLOCK;
+		for (int i = 0; i < 2 * LISTENERS; i++) {
+			memcpy(output[i] + offset, filtered[i] + convPhase, nframes * sizeof(float));
+		}
+		convPhase += nframes;
+		if (convPhase < BLOCK) return;
+		convPhase = 0;
+
+		for (int v = 0; v < VOICES; v++) {
+			convInput[0][v].push(convolution, heard[v]);
+			convInput[1][v].push(convolution, heard[v]);
+			heard[v] = false;
+		}
+
+		float time[Convolution::SIZE];
+		float faded[Convolution::SIZE];
+		for (int l = 0; l < LISTENERS; l++) {
+			for (int e = 0; e < 2; e++) {
+				bool audible = false;
+				bool fading = false;
+				for (int v = l * CHANNELS; v < (l + 1) * CHANNELS; v++) {
+					const Convolution::Input& in = convInput[e][v];
+					int index = filterIndex[e][v];
+					if (in.silent()) {
+						filterShown[e][v] = index;
+						continue;
+					}
+					if (!audible) spectrum[0].clear();
+					audible = true;
+					if (filterShown[e][v] == index) {
+						in.filterInto(spectrum[0], headFilters.get(index));
+						continue;
+					}
+					if (!fading) {
+						spectrum[1].clear();
+						spectrum[2].clear();
 					}
-					output[i][f] = value;
+					fading = true;
+					in.filterInto(spectrum[1], headFilters.get(index));
+					in.filterInto(spectrum[2], headFilters.get(filterShown[e][v]));
+					filterShown[e][v] = index;
 				}
-			}
-		} else {
-			for (int i = 0; i < 2; i++) {
-				batches = nframes / avgBatchSize;
-				for (int b = 0; b < batches; b++) {
-					// Fill delay buffer
-					for (int ch = 0; ch < CHANNELS; ch++) delayBuffer[ch] = avg[i][ch].popData();
-					for (int f = 0; f < avgBatchSize; f++) {
-						value = 0.f;
-						// Get every frame from the right buffer
-						for (int ch = 0; ch < CHANNELS; ch++) {
-							value += (getInterpolatedValue(ch, (f + b * avgBatchSize) - delayBuffer[ch]) * attenuation[i][ch]);
-						}
-						output[i][f + b * avgBatchSize] = value;
+
+				float* out = filtered[2 * l + e];
+				if (!audible) {
+					memset(out, 0, BLOCK * sizeof(float));
+					continue;
+				}
+				convolution.inverse(spectrum[0], time);
+				memcpy(out, time + BLOCK, BLOCK * sizeof(float));
+				if (fading) {
+					convolution.inverse(spectrum[1], time);
+					convolution.inverse(spectrum[2], faded);
+					for (int i = 0; i < BLOCK; i++) {
+						float in = (i + 1.f) / BLOCK;
+						out[i] += in * time[BLOCK + i] + (1.f - in) * faded[BLOCK + i];
 					}
 				}
 			}
-			if (timer > timerOverrun) {
-				useAverage = false;
-				timer = 0;
+		}
+	}
+
+	// Filters of both ears of every voice for the directions of the sources
+	void chooseFilters() {
+		for (int l = 0; l < LISTENERS; l++) {
+			for (int ch = 0; ch < CHANNELS; ch++) {
+				float azimuth = geometry[l].direction(ch);
+				// The left ear hears the source like the right ear a mirrored one
+				filterIndex[0][l * CHANNELS + ch] = HeadFilters::index(-azimuth);
+				filterIndex[1][l * CHANNELS + ch] = HeadFilters::index(azimuth);
 			}
 		}
-		generalBufferPointer += nframes;
-		if (generalBufferPointer >= BUFFER_SIZE) generalBufferPointer -= BUFFER_SIZE;
 	}
 
-	void update_data(float r, float pdist, float eardist, float a0, float rel_delay) {
-		if (r == 0) r = 0.01f;
-		// Define angles
-		// Angle between two sources
-		float alpha = (pdist > 2 * r) ? M_PI : (2 * asin(pdist / (2.0 * r)));
-		// float alpha0 = 0.f; // Initial angle of center [rad] (center = 0, right > 0)
-		float alpha_p[CHANNELS]; // Angle of individual sources [rad] (center = 0, right > 0)
-
-		// Calculate angles of individual sources
-		// First for symmetrical setup...
-		if (CHANNELS % 2 == 0) {
-			for (int i = 0; i < CHANNELS / 2; i++) {
-				alpha_p[(CHANNELS / 2) + i] = (0.5f + i) * alpha;
-				alpha_p[(CHANNELS / 2) - (1 + i)] = -alpha_p[(CHANNELS / 2) + i];
+	// The inputs are only cleared once binaural mode has written them
+	void cleanBinaural() {
+		for (int v = 0; v < VOICES; v++) {
+			if (convWritten) {
+				convInput[0][v].clean();
+				convInput[1][v].clean();
 			}
-		} else {
-			alpha_p[CHANNELS / 2] = 0.f;
-			for (int i = 1; i < CHANNELS / 2; i++) {
-				alpha_p[CHANNELS / 2 + i] = alpha * i; 
-				alpha_p[CHANNELS / 2 - i] = -alpha_p[CHANNELS / 2 + i];
+			heard[v] = false;
+		}
+		convWritten = false;
+		filterShown = filterIndex;
+		for (int i = 0; i < 2 * LISTENERS; i++) memset(filtered[i], 0, sizeof(filtered[i]));
+		convPhase = 0;
+	}
+
+	// Partial stereo sums of group (> 0) for listener l
+	float* sums(int group, int l) {
+		return partial + ((group - 1) * LISTENERS + l) * 2 * blockLimit;
+	}
+
+	// Source of voice v, see the class comment
+	static int source(int v) {
+		return v % CHANNELS;
+	}
+
+	// Static output path: with constant integer delays every channel
+	// contributes a contiguous slice of the delay line to each ear.
+	// All mix functions add the voices [first, last[ of one listener to out0
+	// and out1 and skip the voices whose source only left silence in the
+	// delay line.
+	void mixStatic(float* out0, float* out1, int first, int last, uint32_t nframes) {
+		for (int v = first; v < last; v++) {
+			if (!inputBuffer.silent(source(v))) mixChannelStatic(out0, out1, v, nframes);
+		}
+	}
+
+	void mixChannelStatic(float* out0, float* out1, int v, uint32_t nframes) {
+		mixStereo<STRIDE>(*kernels, out0, out1,
+			inputBuffer.read(source(v), -delay[0][v]), inputBuffer.read(source(v), -delay[1][v]),
+			attenuation[0][v], attenuation[1][v], nframes);
+	}
+
+	// Crossfade output path: a moving channel fades from the integer delay
+	// fadeFrom to fadeTo over fadeLength frames, both read like on the static
+	// path. A delay change during a fade starts the next fade after it.
+	void mixCrossfade(float* out0, float* out1, int first, int last, uint32_t nframes) {
+		for (int v = first; v < last; v++) {
+			if (moving[v]) fadeChannel(out0, out1, v, nframes, !inputBuffer.silent(source(v)));
+			else if (!inputBuffer.silent(source(v))) mixChannelStatic(out0, out1, v, nframes);
+		}
+	}
+
+	// Advance the fades of voice v by nframes frames, mixing them if audible
+	void fadeChannel(float* out0, float* out1, int v, uint32_t nframes, bool audible) {
+		uint32_t start = 0;
+		while (start < nframes && moving[v]) {
+			uint32_t length = fadeLength[v] - fadePosition[v];
+			if (length > nframes - start) length = nframes - start;
+
+			if (audible) {
+				float step = 1.f / fadeLength[v];
+				float in = fadePosition[v] * step;
+				float gain0 = attenuation[0][v];
+				float gain1 = attenuation[1][v];
+				mixStereoRamp<STRIDE>(*kernels, out0 + start, out1 + start,
+					inputBuffer.read(source(v), start - fadeFrom[0][v]), inputBuffer.read(source(v), start - fadeFrom[1][v]),
+					gain0 * (1.f - in), -gain0 * step, gain1 * (1.f - in), -gain1 * step, length);
+				mixStereoRamp<STRIDE>(*kernels, out0 + start, out1 + start,
+					inputBuffer.read(source(v), start - fadeTo[0][v]), inputBuffer.read(source(v), start - fadeTo[1][v]),
+					gain0 * in, gain0 * step, gain1 * in, gain1 * step, length);
+			}
+
+			start += length;
+			fadePosition[v] += length;
+			if (fadePosition[v] == fadeLength[v]) {
+				if (fadeTo[0][v] != delay[0][v] || fadeTo[1][v] != delay[1][v]) {
+					startFade(v, fadeTo[0][v], fadeTo[1][v]);
+				} else {
+					moving[v] = false;
+				}
 			}
 		}
-		// ...then add angle displacement. (You have to convert alpha from degrees to radiant!)
-		for (int i = 0; i < CHANNELS; i++) alpha_p[i] += (a0 / 180.f * M_PI);
+		if (start < nframes && audible) {
+			mixStereo<STRIDE>(*kernels, out0 + start, out1 + start,
+				inputBuffer.read(source(v), start - delay[0][v]), inputBuffer.read(source(v), start - delay[1][v]),
+				attenuation[0][v], attenuation[1][v], nframes - start);
+		}
+	}
+
+	// Fade voice v from the given delays to its current delays
+	void startFade(int v, int from0, int from1) {
+		fadeFrom[0][v] = from0;
+		fadeFrom[1][v] = from1;
+		fadeTo[0][v] = delay[0][v];
+		fadeTo[1][v] = delay[1][v];
+		fadePosition[v] = 0;
+		fadeLength[v] = fadeFrames;
+		moving[v] = true;
+	}
+
+	// Smoothing output path: the averaged delays are constant within every
+	// batch of avgBatchSize frames, so each channel contributes a contiguous
+	// span of the delay line with fixed interpolation weights per batch.
+	// A batch may span several blocks, the first part of the block continues
+	// the batch the previous block stopped in. Channels that are not moving
+	// take the static path.
+	void mixInterpolated(float* out0, float* out1, int first, int last, uint32_t nframes) {
+		for (int v = first; v < last; v++) {
+			if (!moving[v] && !inputBuffer.silent(source(v))) mixChannelStatic(out0, out1, v, nframes);
+		}
+
+		uint32_t start = 0;
+		while (start < nframes) {
+			uint32_t phase = (batchPhase + start) % avgBatchSize;
+			uint32_t length = avgBatchSize - phase;
+			if (length > nframes - start) length = nframes - start;
+
+			for (int v = first; v < last; v++) {
+				if (!moving[v]) continue;
+				// Next data point of the smoother at the start of every batch
+				if (phase == 0) {
+					smoothDelay[0][v] = avg[0][v].popData();
+					smoothDelay[1][v] = avg[1][v].popData();
+				}
+				if (inputBuffer.silent(source(v))) continue;
+				if (interpolationMode == INTERPOLATION_CUBIC) {
+					mixChannelFir(out0 + start, out1 + start, v, start, length, lagrangeTable());
+				} else if (interpolationMode == INTERPOLATION_SINC) {
+					mixChannelFir(out0 + start, out1 + start, v, start, length, sincTable());
+				} else {
+					mixChannelLinear(out0 + start, out1 + start, v, start, length);
+				}
+			}
+			start += length;
+		}
+	}
+
+	// Mix nframes frames of voice v, starting start frames into the block,
+	// at its smoothed delays
+	void mixChannelLinear(float* out0, float* out1, int v, uint32_t start, uint32_t nframes) {
+		// Split the negated delay into integer part and weight, so that the
+		// weights do not depend on where the block starts. The delay line
+		// takes care of the wrap.
+		float position0 = -smoothDelay[0][v];
+		float position1 = -smoothDelay[1][v];
+		int index0 = (int) floorf(position0);
+		int index1 = (int) floorf(position1);
+
+		mixStereoInterpolated<STRIDE>(*kernels, out0, out1,
+			inputBuffer.read(source(v), start + index0), inputBuffer.read(source(v), start + index1),
+			position0 - index0, position1 - index1,
+			attenuation[0][v], attenuation[1][v], nframes);
+	}
+
+	// Same as mixChannelLinear, but with the coefficients of the quantized
+	// fractional delay taken from a polyphase table
+	template <int TAPS>
+	void mixChannelFir(float* out0, float* out1, int v, uint32_t start, uint32_t nframes,
+		const PolyphaseTable<TAPS>& table) {
+		// The filters look TAPS / 2 samples ahead, which have not been
+		// buffered yet for very short delays: use linear interpolation there
+		if (smoothDelay[0][v] < TAPS / 2 || smoothDelay[1][v] < TAPS / 2) {
+			mixChannelLinear(out0, out1, v, start, nframes);
+			return;
+		}
 
-		double posx, posy, time_l, time_r;
-		double att = 1.0;
+		float position0 = -smoothDelay[0][v];
+		float position1 = -smoothDelay[1][v];
+		int index0 = (int) floorf(position0);
+		int index1 = (int) floorf(position1);
 
-		for (int i = 0; i < CHANNELS; i++) {
-			// Calculate position of source
-			posx = r * sin(alpha_p[i]);
-			posy = r * cos(alpha_p[i]);
+		mixStereoFir<TAPS, STRIDE>(*kernels, out0, out1,
+			inputBuffer.read(source(v), start + index0 - table.BEFORE), inputBuffer.read(source(v), start + index1 - table.BEFORE),
+			table.get(position0 - index0), table.get(position1 - index1),
+			attenuation[0][v], attenuation[1][v], nframes);
+	}
 
-			// Calculate distance to listener
-			dist[0][i] = sqrt(pow((posx + eardist / 2.0), 2) + pow(posy, 2));
-			dist[1][i] = sqrt(pow((posx - eardist / 2.0), 2) + pow(posy, 2));
+	// Process one block with the parameters of the control ports. Hosts that
+	// send events call beginRun(), runFrames() for the parts between the
+	// events, setParameter() for the events and endRun() instead.
+	void runBase(uint32_t nframes) {
+		beginRun();
+		runFrames(0, nframes);
+		endRun(nframes);
+	}
 
-			// Calculate attenuation and build product over attenuation
-			attenuation[0][i] = r / dist[0][i];
-			attenuation[1][i] = r / dist[1][i];
-			att *= attenuation[0][i];
-			att *= attenuation[1][i];
+	// Start a block: take over the control ports that changed since the last block
+	void beginRun() {
+		clock_gettime(CLOCK_MONOTONIC, &runStart);
 
-			// Calculate sample delay
-			time_l = dist[0][i] / v_air;
-			time_r = dist[1][i] / v_air;
-			delay[0][i] = (int) round(time_l / (1.0 / sample_rate));
-			delay[1][i] = (int) round(time_r / (1.0 / sample_rate));
+		float* ports[PARAMETERS] = { radius, player_dist, ear_dist, alpha0, window_size, relative_delays };
+		for (int p = 0; p < PARAMETERS; p++) {
+			if (*ports[p] != portValue[p]) {
+				portValue[p] = *ports[p];
+				parameter[p] = portValue[p];
+			}
+		}
+		interpolationMode = (int) (*interpolation + 0.5f);
+
+		if (layout) layoutMode = (int) (*layout + 0.5f);
+		if (delay_mode) delayMode = (int) (*delay_mode + 0.5f);
+		if (output_format) outputFormat = (int) (*output_format + 0.5f);
+		if (speakers) {
+			speakerCount = (int) (*speakers + 0.5f);
+			if (speakerCount < Surround::MIN_SPEAKERS) speakerCount = Surround::MIN_SPEAKERS;
+			if (speakerCount > Surround::OUTPUTS) speakerCount = Surround::OUTPUTS;
 		}
+		// The head filters only apply to the ears
+		if (binaural) binauralMode = (*binaural > 0.5f) && outputFormat == OUTPUT_STEREO;
+		if (air_absorption) airMode = (*air_absorption > 0.5f);
+		if (early_reflections && room_width && room_depth && room_height && absorption) {
+			// Clamped, so that the buffer holds the longest reflection
+			float on = (*early_reflections > 0.5f);
+			float width = fminf(fmaxf(*room_width, 2.f), ROOM_MAX);
+			float depth = fminf(fmaxf(*room_depth, 2.f), ROOM_MAX);
+			float height = fminf(fmaxf(*room_height, 2.5f), ROOM_MAX / 2);
+			float absorb = fminf(fmaxf(*absorption, 0.f), 1.f);
+			for (int l = 0; l < LISTENERS; l++) {
+				if (geometry[l].setRoom(on * width, depth, height, absorb)) sourcesMoved = true;
+			}
+		}
+		if (fade_time) {
+			fadeFrames = *fade_time / 1000.f * sample_rate;
+			if (fadeFrames < 1) fadeFrames = 1;
+		}
+		for (int ch = 0; ch < CHANNELS; ch++) {
+			if (!source_azimuth[ch] || !source_distance[ch]) continue;
+			if (*source_azimuth[ch] != azimuthValue[ch] || *source_distance[ch] != distanceValue[ch]) {
+				azimuthValue[ch] = *source_azimuth[ch];
+				distanceValue[ch] = *source_distance[ch];
+				float distance = fminf(distanceValue[ch], MAX_DISTANCE);
+				for (int l = 0; l < LISTENERS; l++) geometry[l].setSource(ch, azimuthValue[ch], distance);
+				sourcesMoved = true;
+			}
+		}
+		for (int l = 1; l < LISTENERS; l++) {
+			if (!listener_x[l] || !listener_y[l] || !listener_heading[l]) continue;
+			// Clamped, so that the buffer holds the longest delay
+			float x = fminf(fmaxf(*listener_x[l], -LISTENER_RANGE), LISTENER_RANGE);
+			float y = fminf(fmaxf(*listener_y[l], -LISTENER_RANGE), LISTENER_RANGE);
+			if (geometry[l].setListener(x, y, *listener_heading[l])) sourcesMoved = true;
+		}
+	}
+
+	// Set a parameter from an event, it takes effect with the next frame processed
+	void setParameter(int p, float value) {
+		if (p >= 0 && p < PARAMETERS) parameter[p] = value;
+	}
+
+	// Process the frames [offset, offset + nframes[ of the current block
+	void runFrames(uint32_t offset, uint32_t nframes) {
+		if (nframes == 0) return;
 
-		if (rel_delay > 0.5) {
-			// Reduce to relative delay between sources only
-			int min = delay[0][0];
+		// Update data if necessary
+		if (parameter[PARAMETER_WINDOW] != window_target) {
+			window_target = parameter[PARAMETER_WINDOW];
+			// Clamped to the range of the port, an empty window has no
+			// delays to average
+			float window = fminf(fmaxf(window_target, 0.1f), 1.9f);
 			for (int i = 0; i < 2; i++) {
+				for (int v = 0; v < VOICES; v++) {
+					avg[i][v].setWindowSize(window * sample_rate / avgBatchSize);
+				}
+			}
+			timerOverrun = (avg[0][0].getWindowSize() + 2) * avgBatchSize;
+			if (delayMode == DELAY_GLIDE) smoothAll();
+		}
+		if (delayMode != delay_mode_target) {
+			delay_mode_target = delayMode;
+			switchDelayMode();
+		}
+		if (parameter[PARAMETER_RADIUS] != r_target
+			|| parameter[PARAMETER_PLAYER_DIST] != pdist_target
+			|| parameter[PARAMETER_EAR_DIST] != edist_target
+			|| parameter[PARAMETER_ALPHA0] != a0_target
+			|| parameter[PARAMETER_RELATIVE_DELAYS] != rel_delay_target
+			|| layoutMode != layout_target
+			|| outputFormat != format_target
+			|| speakerCount != speakers_target
+			|| sourcesMoved) {
+			bool formatChanged = (outputFormat != format_target || speakerCount != speakers_target);
+			format_target = outputFormat;
+			speakers_target = speakerCount;
+			r_target = parameter[PARAMETER_RADIUS];
+			pdist_target = parameter[PARAMETER_PLAYER_DIST];
+			edist_target = parameter[PARAMETER_EAR_DIST];
+			a0_target = parameter[PARAMETER_ALPHA0];
+			rel_delay_target = parameter[PARAMETER_RELATIVE_DELAYS];
+			layout_target = layoutMode;
+			sourcesMoved = false;
+			for (int l = 0; l < LISTENERS; l++) geometry[l].setLayout(layout_target);
+			// Clamped, so that the buffer holds the longest delay
+			update_data(fminf(r_target, MAX_DISTANCE), pdist_target, fminf(edist_target, MAX_EAR_DISTANCE), a0_target, rel_delay_target);
+			// A new format starts with its gains
+			if (formatChanged) {
+				encoding = encodingTarget;
+				encodingPosition = encodingLength = 0;
+			}
+		}
+		if (binauralMode != binaural_target) {
+			// The filters start from silence, the latency changes anyway
+			binaural_target = binauralMode;
+			chooseFilters();
+			cleanBinaural();
+		}
+		if (airMode != air_target) {
+			// The filters start from silence at their current distances
+			air_target = airMode;
+			air.clean();
+		}
+
+		// Long blocks are processed in parts, which fit into the guard region
+		// of the delay line and end at the partitions of the binaural filters,
+		// or fit into the buffers of the voices
+		for (uint32_t done = 0, length; done < nframes; done += length) {
+			length = nframes - done;
+			if (length > (uint32_t) blockLimit) length = blockLimit;
+			if (binauralMode && length > Convolution::BLOCK - convPhase) length = Convolution::BLOCK - convPhase;
+			else if (!binauralMode && voicesApart() && length > VOICE_BLOCK) length = VOICE_BLOCK;
+			runBlock(offset + done, length);
+		}
+	}
+
+	void endRun(uint32_t nframes) {
+		report(nframes, runStart);
+	}
+
+	// Write the telemetry of the run that started at start to the connected outputs
+	void report(uint32_t nframes, const timespec& start) {
+		if (nframes == 0) return;
+
+		timespec stop;
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		float seconds = (stop.tv_sec - start.tv_sec) + 1e-9f * (stop.tv_nsec - start.tv_nsec);
+
+		// Cost as a fraction of the block duration: its average over about
+		// LOAD_TIME seconds and its peak, which falls back within PEAK_TIME seconds
+		float cost = seconds * sample_rate / nframes;
+		float decay = expf(-(float) nframes / (LOAD_TIME * sample_rate));
+		loadAverage = cost + decay * (loadAverage - cost);
+		loadPeak *= expf(-(float) nframes / (PEAK_TIME * sample_rate));
+		if (cost > loadPeak) loadPeak = cost;
+
+		if (load) *load = loadAverage;
+		if (load_peak) *load_peak = loadPeak;
+		if (smoothing) *smoothing = useAverage ? 1.f : 0.f;
+		if (smoothing_left) {
+			// Until the last moving channel settles
+			int left = 0;
+			for (int v = 0; useAverage && v < VOICES; v++) {
+				if (!moving[v]) continue;
+				int frames = (delayMode == DELAY_GLIDE) ? timerOverrun - timer[v] : fadeLength[v] - fadePosition[v];
+				if (frames > left) left = frames;
+			}
+			*smoothing_left = left;
+		}
+		if (latency) *latency = binauralMode ? Convolution::BLOCK : 0;
+		if (min_delay) *min_delay = minDelay;
+		if (max_delay) *max_delay = maxDelay;
+		// Samples the longest delay could grow before reads overlap the writes
+		uint32_t frames = nframes < (uint32_t) blockLimit ? nframes : blockLimit;
+		if (headroom) *headroom = inputBuffer.getSize() - maxDelay - (int) frames - INTERPOLATION_TAPS;
+	}
+
+	void runBlock(uint32_t offset, uint32_t nframes) {
+		bool glide = (delayMode == DELAY_GLIDE);
+		if (useAverage && glide) {
+			// One data point for every batch that starts within this block
+			uint32_t next = (avgBatchSize - batchPhase) % avgBatchSize;
+			int batches = (next < nframes) ? (nframes - next - 1) / avgBatchSize + 1 : 0;
+			for (int v = 0; v < VOICES; v++) {
+				if (!moving[v]) continue;
+				avg[0][v].pushData(delay[0][v], batches);
+				avg[1][v].pushData(delay[1][v], batches);
+				timer[v] += nframes;
+			}
+		}
+
+		// Step 1: Buffer input
+		inputBuffer.write(input, offset, nframes);
+
+		// Step 2: Output
+		blockOffset = offset;
+		blockFrames = nframes;
+		for (int o = 0; o < Surround::OUTPUTS; o++) {
+			if (surround[o]) memset(surround[o] + offset, 0, nframes * sizeof(float));
+		}
+		bool idle = true;
+		for (int ch = 0; ch < CHANNELS; ch++) idle = idle && inputBuffer.silent(ch);
+		// The reflections are in the delay line, which is silent, but the
+		// air filters ring out first
+		if (idle && airMode) idle = !air.ringing();
+		if (idle) {
+			// Nothing to mix, only keep the smoothers in step
+			if (binauralMode) {
+				for (int v = 0; v < VOICES; v++) {
+					memset(convInput[0][v].block(convPhase), 0, nframes * sizeof(float));
+					memset(convInput[1][v].block(convPhase), 0, nframes * sizeof(float));
+				}
+			} else {
+				for (int l = 0; l < 2 * LISTENERS; l++) memset(output[l] + offset, 0, nframes * sizeof(float));
+			}
+			if (useAverage && glide) skipBatches(nframes);
+			else if (useAverage) {
+				for (int v = 0; v < VOICES; v++) {
+					if (moving[v]) fadeChannel(nullptr, nullptr, v, nframes, false);
+				}
+			}
+		} else if (groups > 1) {
+			workers.run(groups);
+			// Reduce the partial sums into the outputs of their listeners, the
+			// binaural voices are summed by filterVoices()
+			for (int g = 1; !voicesApart() && g < groups; g++) {
+				int first = g * VOICES / groups;
+				int last = (g + 1) * VOICES / groups;
+				for (int l = first / CHANNELS; l * CHANNELS < last; l++) {
+					kernels->addTo(output[2 * l] + offset, sums(g, l), nframes);
+					kernels->addTo(output[2 * l + 1] + offset, sums(g, l) + blockLimit, nframes);
+				}
+			}
+		} else {
+			mixGroup(this, 0);
+		}
+		if (binauralMode) {
+			filterVoices(offset, nframes);
+			convWritten = true;
+		}
+		else if (voicesApart() && !idle) sumVoices(offset, nframes);
+		advanceReflections(nframes);
+		air.advance(nframes);
+		advanceEncoding(nframes);
+		batchPhase = (batchPhase + nframes) % avgBatchSize;
+		if (useAverage) {
+			// Channels whose smoothers have reached their delays go back to the
+			// static path, their smoother output stays at the delay until they
+			// move again. The timer only bounds the glide.
+			useAverage = false;
+			for (int v = 0; v < VOICES; v++) {
+				if (!moving[v]) continue;
+				if (glide && (timer[v] > timerOverrun
+					|| (avg[0][v].settled(delay[0][v]) && avg[1][v].settled(delay[1][v])))) {
+					moving[v] = false;
+					smoothDelay[0][v] = delay[0][v];
+					smoothDelay[1][v] = delay[1][v];
+				} else {
+					useAverage = true;
+				}
+			}
+		}
+		inputBuffer.advance(nframes);
+	}
+
+	// Take the smoother outputs of the batches that start within the next
+	// nframes frames without mixing
+	void skipBatches(uint32_t nframes) {
+		for (uint32_t f = (avgBatchSize - batchPhase) % avgBatchSize; f < nframes; f += avgBatchSize) {
+			for (int v = 0; v < VOICES; v++) {
+				if (!moving[v]) continue;
+				smoothDelay[0][v] = avg[0][v].popData();
+				smoothDelay[1][v] = avg[1][v].popData();
+			}
+		}
+	}
+
+	// Hand the moving channels over to the new delay mode
+	void switchDelayMode() {
+		for (int v = 0; v < VOICES; v++) {
+			if (delayMode == DELAY_CROSSFADE) {
+				// Fade from where the glide is
+				if (moving[v]) startFade(v, (int) lroundf(smoothDelay[0][v]), (int) lroundf(smoothDelay[1][v]));
+			} else {
+				// Glide on from the end of the fade, the smoothers have not
+				// been fed during the crossfades
+				int from0 = moving[v] ? fadeTo[0][v] : delay[0][v];
+				int from1 = moving[v] ? fadeTo[1][v] : delay[1][v];
+				avg[0][v].clean(from0);
+				avg[1][v].clean(from1);
+				smoothDelay[0][v] = from0;
+				smoothDelay[1][v] = from1;
+				moving[v] = (from0 != delay[0][v] || from1 != delay[1][v]);
+				timer[v] = 0;
+			}
+		}
+	}
+
+	void update_data(float r, float pdist, float eardist, float a0, float rel_delay) {
+		// Only the channels whose delays changed take the smoothing path
+		std::array<std::array<int, VOICES>, 2> previous = delay;
+		for (int l = 0; l < LISTENERS; l++) {
+			// In surround formats the center listener hears at its center
+			float ears = (l == 0 && outputFormat != OUTPUT_STEREO) ? 0.f : eardist;
+			geometry[l].update(r, pdist, ears, a0, rel_delay > 0.5, l ? &geometry[0] : nullptr);
+			for (int e = 0; e < 2; e++) {
 				for (int ch = 0; ch < CHANNELS; ch++) {
-					if (delay[i][ch] < min) min = delay[i][ch];
+					attenuation[e][l * CHANNELS + ch] = geometry[l].attenuation[e][ch];
+					delay[e][l * CHANNELS + ch] = geometry[l].delay[e][ch];
 				}
 			}
-			for (int i = 0; i < 2; i++) {
+		}
+
+		if (binauralMode) chooseFilters();
+		for (int ch = 0; ch < CHANNELS; ch++) {
+			Surround::gains(outputFormat, speakerCount, geometry[0].direction(ch), encodingTarget[ch].data());
+		}
+		startEncoding();
+		for (int l = 0; l < LISTENERS; l++) {
+			for (int ch = 0; ch < CHANNELS; ch++) {
+				int v = l * CHANNELS + ch;
+				air.setDistance(2 * v, geometry[l].pathLength(0, ch));
+				air.setDistance(2 * v + 1, geometry[l].pathLength(1, ch));
+			}
+		}
+		air.startRamp(fadeFrames);
+
+		// The reflections of every voice and ear sorted by delay
+		for (int l = 0; l < LISTENERS; l++) {
+			for (int e = 0; e < 2; e++) {
 				for (int ch = 0; ch < CHANNELS; ch++) {
-					delay[i][ch] -= min;
+					int v = l * CHANNELS + ch;
+					for (int w = 0; w < WALLS; w++) {
+						int d = geometry[l].reflectionDelay[e][ch][w];
+						float g = geometry[l].reflectionGain[e][ch][w];
+						int t = w;
+						for (; t > 0 && tapsTarget.delay[e][v][t - 1] > d; t--) {
+							tapsTarget.delay[e][v][t] = tapsTarget.delay[e][v][t - 1];
+							tapsTarget.gain[e][v][t] = tapsTarget.gain[e][v][t - 1];
+						}
+						tapsTarget.delay[e][v][t] = d;
+						tapsTarget.gain[e][v][t] = g;
+					}
 				}
 			}
 		}
+		if (!tapFadeLength && !taps.same(tapsTarget)) startReflections();
 
-		// Normalize attenuation
-		att = 1.f / att;
-		for (int i = 0; i < CHANNELS; i++) {
-			attenuation[0][i] *= att;
-			attenuation[1][i] *= att;
+		// Changes that keep all integer delays only change the gains, the
+		// smoothing path is not needed for them
+		if (delay == previous) {
+			delayRange();
+			return;
 		}
 
-		timer = 0;
-		useAverage = true;
+		for (int v = 0; v < VOICES; v++) {
+			if (delay[0][v] == previous[0][v] && delay[1][v] == previous[1][v]) continue;
+			if (delayMode == DELAY_GLIDE) {
+				moving[v] = true;
+				timer[v] = 0;
+			} else if (!moving[v]) {
+				startFade(v, previous[0][v], previous[1][v]);
+			}
+			useAverage = true;
+		}
+		delayRange();
+	}
+
+	// Shortest and longest delay read from the delay line, see report()
+	void delayRange() {
+		minDelay = maxDelay = delay[0][0];
+		for (int i = 0; i < 2; i++) {
+			for (int v = 0; v < VOICES; v++) {
+				if (delay[i][v] < minDelay) minDelay = delay[i][v];
+				if (delay[i][v] > maxDelay) maxDelay = delay[i][v];
+				// The taps are sorted, the last one is the longest
+				if (tapsAudible && tapsTarget.delay[i][v][WALLS - 1] > maxDelay) maxDelay = tapsTarget.delay[i][v][WALLS - 1];
+			}
+		}
 	}
 
 protected:
-	int BUFFER_SIZE;
-	int CHANNELS;
+	// Longest block processed at once, shorter if the host promises shorter
+	// blocks, see blockLimit
+	static const int MAX_BLOCK = 4096;
+	// Longest block with the voices buffered on their own, see voicesApart()
+	static const int VOICE_BLOCK = 256;
+	// Batches of the longest delay window the smoothers keep, see init()
+	static const int MAX_HISTORY = 1 << 14;
+	// Taps of the longest interpolation filter, see interpolation.hpp
+	static const int INTERPOLATION_TAPS = 16;
+	// Instances with at least PARALLEL_CHANNELS channels mix groups of at least
+	// GROUP_CHANNELS channels on up to MAX_GROUPS threads, see workers.hpp
+	static const int PARALLEL_CHANNELS = 64;
+	static const int GROUP_CHANNELS = 16;
+	static const int MAX_GROUPS = 4;
+	// Time constants of the load outputs in seconds
+	static constexpr float LOAD_TIME = 1.f;
+	static constexpr float PEAK_TIME = 3.f;
+	// Default crossfade time in seconds
+	static constexpr float FADE_TIME = 0.02f;
+	// Ports per further listener (out_left, out_right, x, y, heading) and the
+	// largest distance of their x and y from the center in m
+	static const int LISTENER_PORTS = 5;
+	static constexpr double LISTENER_RANGE = 10.0;
+	// Largest width and depth of the room in m, twice its largest height
+	static constexpr float ROOM_MAX = 30.f;
+	// Largest radius and source distance, and largest ear distance in m:
+	// the maxima of their ports, larger values are clamped
+	static constexpr float MAX_DISTANCE = 20.f;
+	static constexpr float MAX_EAR_DISTANCE = 1.f;
+	static const int WALLS = Geometry<CHANNELS>::WALLS;
+	// Layout of the delay line, STRIDE is the distance of its samples in floats
+	static const int DELAY_TILE = PAN_DELAY_TILE < CHANNELS ? PAN_DELAY_TILE : CHANNELS;
+	static const int STRIDE = DelayLine<CHANNELS, DELAY_TILE>::STRIDE;
 
-	float** input;
-	float* output[2] { 0, 0 };
+	std::array<float*, CHANNELS> input;
+	// Left and right output of every listener
+	std::array<float*, 2 * LISTENERS> output {};
 	float* radius = nullptr;
 	float* player_dist = nullptr;
 	float* ear_dist = nullptr;
 	float* alpha0 = nullptr;
 	float* relative_delays = nullptr;
 	float* window_size = nullptr;
+	float* interpolation = nullptr;
+	float* load = nullptr;
+	float* load_peak = nullptr;
+	float* smoothing = nullptr;
+	float* smoothing_left = nullptr;
+	float* min_delay = nullptr;
+	float* max_delay = nullptr;
+	float* headroom = nullptr;
+	float* layout = nullptr;
+	std::array<float*, CHANNELS> source_azimuth;
+	std::array<float*, CHANNELS> source_distance;
+	float* delay_mode = nullptr;
+	float* fade_time = nullptr;
+	std::array<float*, LISTENERS> listener_x, listener_y, listener_heading;
+	float* binaural = nullptr;
+	float* latency = nullptr;
+	float* early_reflections = nullptr;
+	float* room_width = nullptr;
+	float* room_depth = nullptr;
+	float* room_height = nullptr;
+	float* absorption = nullptr;
+	float* air_absorption = nullptr;
+	float* output_format = nullptr;
+	float* speakers = nullptr;
+	// Surround outputs of the center listener
+	std::array<float*, Surround::OUTPUTS> surround {};
 
 	float r_target = 0;
 	float pdist_target = 0;
 	float edist_target = 0;
 	float a0_target = 0;
 	float sample_rate;
+	// Set by the host before init()
+	BlockLengths blockLengths;
+	// Threads an instance mixes on at most, a subclass may bound them before
+	// init(). 0 leaves them to the cores.
+	int maxThreads = 0;
+	// The kernels of the CPU, see dispatch.hpp. Set by the constructor, a
+	// subclass may choose others before init().
+	const Kernels* kernels;
+	int blockLimit;
 	float v_air = 343.2;
 	float rel_delay_target = 0;
 	float window_target = 1.0;
+	int interpolationMode;
 
-	int** delay;
-	float** attenuation;
-	TriangularAverage** avg;
+	// Parameter values by port index, set by the control ports or by events.
+	// A port only takes effect when its value differs from the last block.
+	std::array<float, PARAMETERS> parameter;
+	std::array<float, PARAMETERS> portValue;
+	// Same for the layout, the source and the listener ports, a moved source
+	// only updates itself
+	int layoutMode, layout_target;
+	std::array<float, CHANNELS> azimuthValue, distanceValue;
+	bool sourcesMoved;
 
-	double** dist;
+	// Per voice, see the class comment
+	std::array<std::array<int, VOICES>, 2> delay;
+	std::array<std::array<float, VOICES>, 2> attenuation;
+	std::array<std::array<TriangularAverage, VOICES>, 2> avg;
+	// Output of avg for the current batch
+	std::array<std::array<float, VOICES>, 2> smoothDelay;
 
-	float** inputBuffer;
+	std::array<Geometry<CHANNELS>, LISTENERS> geometry;
+	int minDelay, maxDelay;
 
-	float *delayBuffer;
+	// Memory of the delay line, the convolution and the scratch buffers
+	Arena arena;
+	DelayLine<CHANNELS, DELAY_TILE> inputBuffer;
 
-	int generalBufferPointer;
+	int groups;
+	float* partial = nullptr;
+	uint32_t blockOffset, blockFrames;
+	WorkerPool workers;
 
 	int avgBatchSize;
-	int timer, timerOverrun;
+	// Voices on the smoothing path and the frames since their last change,
+	// useAverage is set if any voice is moving
+	std::array<bool, VOICES> moving;
+	std::array<int, VOICES> timer;
+	int timerOverrun;
 	bool useAverage;
+
+	// Crossfade mode: delays faded from and to, progress and length of the fades
+	int delayMode, delay_mode_target;
+	int fadeFrames;
+	std::array<std::array<int, VOICES>, 2> fadeFrom, fadeTo;
+	std::array<uint32_t, VOICES> fadePosition, fadeLength;
+	// Frames of the current batch processed so far
+	uint32_t batchPhase;
+
+	// Binaural mode: convolution inputs of both ears of every voice, whether
+	// the voice was heard in the current partition, the filters chosen and
+	// the filters the last partition was heard through, and the output of
+	// the last partition of every listener and ear
+	bool binauralMode, binaural_target;
+	bool convWritten;
+	Convolution convolution;
+	HeadFilters headFilters;
+	std::array<std::array<Convolution::Input, VOICES>, 2> convInput;
+	std::array<bool, VOICES> heard;
+	std::array<std::array<int, VOICES>, 2> filterIndex, filterShown;
+	Convolution::Spectrum spectrum[3];
+	float filtered[2 * LISTENERS][Convolution::BLOCK];
+	uint32_t convPhase;
+
+	// Early reflections: the taps of both ears of every voice, sorted by delay
+	struct Taps {
+		std::array<std::array<std::array<int, WALLS>, VOICES>, 2> delay;
+		std::array<std::array<std::array<float, WALLS>, VOICES>, 2> gain;
+
+		bool same(const Taps& other) const {
+			return delay == other.delay && gain == other.gain;
+		}
+	};
+	// Taps mixed, faded from and of the last geometry update, the progress
+	// of the fade (no fade with length 0) and whether any tap has a gain
+	Taps taps, tapsFrom, tapsTarget;
+	uint32_t tapFadePosition, tapFadeLength;
+	bool tapsAudible;
+
+	// Air absorption: one filter per voice and ear (path 2 * voice + ear),
+	// and without binaural mode the signals of the voices of a block
+	bool airMode, air_target;
+	AirAbsorption<2 * VOICES> air;
+	float* voiced = nullptr;
+
+	// Surround formats: gains of every source on the surround outputs at
+	// the start of their ramp, their increments per frame and their targets
+	// of the last geometry update
+	int outputFormat, format_target;
+	int speakerCount, speakers_target;
+	std::array<std::array<float, Surround::OUTPUTS>, CHANNELS> encoding, encodingStep, encodingTarget;
+	uint32_t encodingPosition, encodingLength;
+
+	timespec runStart;
+	float loadAverage, loadPeak;
 };
\ No newline at end of file
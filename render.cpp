@@ -0,0 +1,369 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// Offline renderer: pans N mono files into one stereo file, faster than
+// real time and with several jobs in parallel.
+//
+// Usage: pan-render [options] radius pdist edist alpha0 window relative output input...
+//        pan-render [options] -j jobfile
+//
+// Options:
+//   -b frames   block size passed to runBase() (default 256). The output is
+//               identical to the plugin's output in a host that runs fixed
+//               blocks of the same size.
+//   -i mode     interpolation: 0 linear, 1 cubic Lagrange, 2 windowed sinc
+//   -r rate     sample rate of raw input files (default 48000)
+//   -t threads  number of parallel jobs (default: number of cores). Large
+//               ensembles mix on the cores the parallel jobs leave.
+//   -j file     read the jobs from file, one job per line with the same
+//               fields as on the command line; lines starting with # are ignored
+//
+// Inputs are mono WAV files (16, 24 or 32 bit PCM or 32 bit float) or raw
+// native 32 bit float files ending in .raw. The output is written as 32 bit
+// float WAV, or as raw interleaved stereo floats if its name ends in .raw.
+// The output has the length of the longest input, shorter inputs are padded
+// with silence.
+
+#include "pan.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+template <int N>
+class RenderPan : public Pan<N> {
+public:
+	RenderPan(int srate, int block, int threads) {
+		this->sample_rate = srate;
+		this->maxThreads = threads;
+		this->blockLengths.minimum = this->blockLengths.nominal = this->blockLengths.maximum = block;
+		this->blockLengths.fixed = true;
+		this->blockLengths.powerOf2 = (block & (block - 1)) == 0;
+		this->init(srate);
+	}
+};
+
+struct Options {
+	int block = 256;
+	int interpolation = INTERPOLATION_LINEAR;
+	int rate = 48000;
+	int threads = 0;
+	// Threads of each job, the cores the parallel jobs leave
+	int jobThreads = 1;
+};
+
+struct Job {
+	// radius, player distance, ear distance, alpha 0, window, relative delays
+	float controls[6];
+	std::string output;
+	std::vector<std::string> inputs;
+};
+
+struct Audio {
+	int rate = 0;
+	std::vector<float> samples;
+};
+
+static bool endsWith(const std::string& s, const char* suffix) {
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static uint32_t readLE(const unsigned char* p, int bytes) {
+	uint32_t value = 0;
+	for (int i = bytes - 1; i >= 0; i--) value = (value << 8) | p[i];
+	return value;
+}
+
+static bool readFile(const std::string& path, std::vector<unsigned char>& data) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return false;
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+static bool readRaw(const std::string& path, int rate, Audio& audio, std::string& error) {
+	std::vector<unsigned char> data;
+	if (!readFile(path, data)) {
+		error = "cannot read " + path;
+		return false;
+	}
+	audio.rate = rate;
+	audio.samples.resize(data.size() / sizeof(float));
+	memcpy(audio.samples.data(), data.data(), audio.samples.size() * sizeof(float));
+	return true;
+}
+
+static bool readWav(const std::string& path, Audio& audio, std::string& error) {
+	std::vector<unsigned char> data;
+	if (!readFile(path, data)) {
+		error = "cannot read " + path;
+		return false;
+	}
+	if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) || memcmp(data.data() + 8, "WAVE", 4)) {
+		error = path + " is not a WAV file";
+		return false;
+	}
+
+	int format = 0, channels = 0, bits = 0;
+	const unsigned char* samples = nullptr;
+	size_t length = 0;
+	for (size_t pos = 12; pos + 8 <= data.size();) {
+		const unsigned char* chunk = data.data() + pos;
+		size_t size = readLE(chunk + 4, 4);
+		if (pos + 8 + size > data.size()) size = data.size() - pos - 8;
+
+		if (!memcmp(chunk, "fmt ", 4) && size >= 16) {
+			format = readLE(chunk + 8, 2);
+			channels = readLE(chunk + 10, 2);
+			audio.rate = readLE(chunk + 12, 4);
+			bits = readLE(chunk + 22, 2);
+			// WAVE_FORMAT_EXTENSIBLE: the format is the start of the sub format GUID
+			if (format == 0xFFFE && size >= 26) format = readLE(chunk + 32, 2);
+		} else if (!memcmp(chunk, "data", 4)) {
+			samples = chunk + 8;
+			length = size;
+		}
+		pos += 8 + size + (size & 1);
+	}
+
+	if (!samples || channels != 1) {
+		error = path + " is not a mono WAV file";
+		return false;
+	}
+
+	bool isFloat = format == 3 && bits == 32;
+	bool isPcm = format == 1 && (bits == 16 || bits == 24 || bits == 32);
+	if (!isFloat && !isPcm) {
+		error = path + ": unsupported sample format";
+		return false;
+	}
+
+	int bytes = bits / 8;
+	size_t frames = length / bytes;
+	audio.samples.resize(frames);
+	if (isFloat) {
+		memcpy(audio.samples.data(), samples, frames * sizeof(float));
+	} else {
+		for (size_t i = 0; i < frames; i++) {
+			// Shift into the upper bits to keep the sign
+			int32_t value = readLE(samples + i * bytes, bytes) << (32 - bits);
+			audio.samples[i] = value / 2147483648.f;
+		}
+	}
+	return true;
+}
+
+static void writeLE(std::vector<unsigned char>& data, uint32_t value, int bytes) {
+	for (int i = 0; i < bytes; i++) data.push_back((value >> (8 * i)) & 0xFF);
+}
+
+static bool writeOutput(const std::string& path, const std::vector<float>& interleaved, int rate) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	if (!endsWith(path, ".raw")) {
+		uint32_t size = interleaved.size() * sizeof(float);
+		std::vector<unsigned char> header;
+		header.insert(header.end(), { 'R', 'I', 'F', 'F' });
+		writeLE(header, 36 + size, 4);
+		header.insert(header.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+		writeLE(header, 16, 4);
+		writeLE(header, 3, 2);	// IEEE float
+		writeLE(header, 2, 2);	// channels
+		writeLE(header, rate, 4);
+		writeLE(header, rate * 2 * sizeof(float), 4);
+		writeLE(header, 2 * sizeof(float), 2);
+		writeLE(header, 32, 2);
+		header.insert(header.end(), { 'd', 'a', 't', 'a' });
+		writeLE(header, size, 4);
+		file.write((const char*) header.data(), header.size());
+	}
+	file.write((const char*) interleaved.data(), interleaved.size() * sizeof(float));
+	return (bool) file;
+}
+
+template <int N>
+static bool render(const Job& job, const std::vector<Audio>& inputs, const Options& options, std::string& error) {
+	int rate = inputs[0].rate;
+	size_t frames = 0;
+	for (const Audio& audio : inputs) {
+		if (audio.rate != rate) {
+			error = job.output + ": inputs have different sample rates";
+			return false;
+		}
+		if (audio.samples.size() > frames) frames = audio.samples.size();
+	}
+
+	int block = options.block;
+	RenderPan<N> pan(rate, block, options.jobThreads);
+	float controls[6];
+	float interpolation = options.interpolation;
+	memcpy(controls, job.controls, sizeof(controls));
+
+	std::vector<float> input(N * block), output(2 * block);
+	std::vector<float> interleaved(2 * frames);
+
+	for (int i = 0; i < 6; i++) pan.connect_portBase(i, &controls[i]);
+	pan.connect_portBase(6, output.data());
+	pan.connect_portBase(7, output.data() + block);
+	for (int ch = 0; ch < N; ch++) pan.connect_portBase(8 + ch, input.data() + ch * block);
+	pan.connect_portBase(8 + N, &interpolation);
+	pan.activateBase();
+
+	for (size_t start = 0; start < frames; start += block) {
+		int length = (frames - start < (size_t) block) ? frames - start : block;
+		for (int ch = 0; ch < N; ch++) {
+			const std::vector<float>& samples = inputs[ch].samples;
+			for (int f = 0; f < length; f++) {
+				input[ch * block + f] = (start + f < samples.size()) ? samples[start + f] : 0.f;
+			}
+		}
+
+		pan.runBase(length);
+
+		for (int f = 0; f < length; f++) {
+			interleaved[2 * (start + f)] = output[f];
+			interleaved[2 * (start + f) + 1] = output[block + f];
+		}
+	}
+
+	if (!writeOutput(job.output, interleaved, rate)) {
+		error = "cannot write " + job.output;
+		return false;
+	}
+	return true;
+}
+
+static bool runJob(const Job& job, const Options& options, std::string& error) {
+	std::vector<Audio> inputs(job.inputs.size());
+	for (size_t i = 0; i < inputs.size(); i++) {
+		bool ok = endsWith(job.inputs[i], ".raw")
+			? readRaw(job.inputs[i], options.rate, inputs[i], error)
+			: readWav(job.inputs[i], inputs[i], error);
+		if (!ok) return false;
+	}
+
+	// Same channel counts as exported by the plugin
+	switch (inputs.size()) {
+	case 2: return render<2>(job, inputs, options, error);
+	case 4: return render<4>(job, inputs, options, error);
+	case 5: return render<5>(job, inputs, options, error);
+	case 8: return render<8>(job, inputs, options, error);
+	case 9: return render<9>(job, inputs, options, error);
+	case 12: return render<12>(job, inputs, options, error);
+	case 16: return render<16>(job, inputs, options, error);
+	case 24: return render<24>(job, inputs, options, error);
+	case 32: return render<32>(job, inputs, options, error);
+	case 64: return render<64>(job, inputs, options, error);
+	case 128: return render<128>(job, inputs, options, error);
+	}
+	error = job.output + ": no plugin with " + std::to_string(inputs.size()) + " inputs";
+	return false;
+}
+
+// Parse the fields of one job: six control values, the output and the inputs
+static bool parseJob(const std::vector<std::string>& fields, Job& job) {
+	if (fields.size() < 8) return false;
+	for (int i = 0; i < 6; i++) {
+		char* end;
+		job.controls[i] = strtof(fields[i].c_str(), &end);
+		if (*end) return false;
+	}
+	job.output = fields[6];
+	job.inputs.assign(fields.begin() + 7, fields.end());
+	return true;
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	std::vector<Job> jobs;
+	std::vector<std::string> fields;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "-b" && hasValue) options.block = atoi(argv[++i]);
+		else if (arg == "-i" && hasValue) options.interpolation = atoi(argv[++i]);
+		else if (arg == "-r" && hasValue) options.rate = atoi(argv[++i]);
+		else if (arg == "-t" && hasValue) options.threads = atoi(argv[++i]);
+		else if (arg == "-j" && hasValue) {
+			std::ifstream file(argv[++i]);
+			if (!file) {
+				fprintf(stderr, "Cannot read %s\n", argv[i]);
+				return 1;
+			}
+			std::string line;
+			for (int n = 1; std::getline(file, line); n++) {
+				std::istringstream stream(line);
+				std::vector<std::string> jobFields;
+				for (std::string field; stream >> field;) jobFields.push_back(field);
+				if (jobFields.empty() || jobFields[0][0] == '#') continue;
+
+				Job job;
+				if (!parseJob(jobFields, job)) {
+					fprintf(stderr, "%s:%d: invalid job\n", argv[i], n);
+					return 1;
+				}
+				jobs.push_back(job);
+			}
+		}
+		else fields.push_back(arg);
+	}
+
+	if (!fields.empty()) {
+		Job job;
+		if (!parseJob(fields, job)) {
+			fprintf(stderr, "Usage: %s [-b block] [-i interpolation] [-r rate] [-t threads]"
+				" radius pdist edist alpha0 window relative output input...\n"
+				"       %s [-b block] [-i interpolation] [-r rate] [-t threads] -j jobfile\n",
+				argv[0], argv[0]);
+			return 1;
+		}
+		jobs.push_back(job);
+	}
+	if (options.block < 1) options.block = 1;
+	int cores = WorkerPool::available();
+	if (options.threads < 1) options.threads = cores;
+	// Jobs that already fill the cores mix on their own thread
+	int parallel = (options.threads < (int) jobs.size()) ? options.threads : jobs.size();
+	if (parallel > 0 && cores / parallel > 1) options.jobThreads = cores / parallel;
+
+	// Every worker takes the next job until all are done
+	std::atomic<size_t> next(0);
+	std::atomic<int> failed(0);
+	auto worker = [&]() {
+		for (size_t i = next++; i < jobs.size(); i = next++) {
+			std::string error;
+			if (!runJob(jobs[i], options, error)) {
+				fprintf(stderr, "%s\n", error.c_str());
+				failed++;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < options.threads && t < (int) jobs.size(); t++) threads.emplace_back(worker);
+	for (std::thread& thread : threads) thread.join();
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <math.h>
+
+// Output formats, values of the output format control port
+enum OutputFormat {
+	// Left and right ear of every listener
+	OUTPUT_STEREO = 0,
+	// Ambisonics of first and third order, ACN channel order with SN3D
+	// normalization (AmbiX)
+	OUTPUT_AMBISONICS_1 = 1,
+	OUTPUT_AMBISONICS_3 = 2,
+	// A ring of equally spaced speakers, the first one in front, the
+	// others following clockwise
+	OUTPUT_RING = 3
+};
+
+// Gains of a source in the horizontal plane on the surround outputs
+class Surround {
+public:
+	// Channels of third order Ambisonics, also the most speakers of a ring
+	static const int OUTPUTS = 16;
+	static const int MIN_SPEAKERS = 3;
+
+	// Outputs used by format
+	static int outputs(int format, int speakers) {
+		switch (format) {
+		case OUTPUT_AMBISONICS_1: return 4;
+		case OUTPUT_AMBISONICS_3: return 16;
+		case OUTPUT_RING: return speakers;
+		default: return 0;
+		}
+	}
+
+	// Gains of all outputs(format, speakers) outputs for a source at azimuth
+	// degrees (0 = front, positive to the right)
+	static void gains(int format, int speakers, float azimuth, float* gain) {
+		if (format == OUTPUT_RING) ring(speakers, azimuth, gain);
+		else if (format == OUTPUT_AMBISONICS_1) ambisonics(1, azimuth, gain);
+		else if (format == OUTPUT_AMBISONICS_3) ambisonics(3, azimuth, gain);
+	}
+
+private:
+	// Real spherical harmonics up to order at elevation 0, ACN index
+	// l * l + l + m. Ambisonics counts the azimuth counterclockwise.
+	// SN3D: sqrt((2 - [m = 0]) (l - |m|)! / (l + |m|)!) times the Legendre
+	// function without Condon-Shortley phase, which is at 0
+	// (-1)^((l - |m|) / 2) (l + |m| - 1)!! / (l - |m|)!! for even l + |m|
+	// and 0 otherwise.
+	static void ambisonics(int order, float azimuth, float* gain) {
+		double phi = -azimuth / 180.0 * M_PI;
+		for (int l = 0; l <= order; l++) {
+			for (int m = -l; m <= l; m++) {
+				int a = (m < 0) ? -m : m;
+				double value = 0.0;
+				if ((l + a) % 2 == 0) {
+					double norm = (a == 0) ? 1.0 : 2.0;
+					for (int k = l - a + 1; k <= l + a; k++) norm /= k;
+					double legendre = ((l - a) / 2 % 2) ? -1.0 : 1.0;
+					for (int k = l + a - 1; k > 1; k -= 2) legendre *= k;
+					for (int k = l - a; k > 1; k -= 2) legendre /= k;
+					value = sqrt(norm) * legendre * ((m < 0) ? sin(a * phi) : cos(a * phi));
+				}
+				gain[l * l + l + m] = value;
+			}
+		}
+	}
+
+	// Constant power panning between the two speakers next to the source
+	static void ring(int speakers, float azimuth, float* gain) {
+		double position = remainder(azimuth, 360.0) / 360.0 * speakers;
+		if (position < 0.0) position += speakers;
+		int first = (int) position % speakers;
+		double t = position - floor(position);
+		for (int s = 0; s < speakers; s++) gain[s] = 0.f;
+		gain[first] = cos(t * M_PI / 2);
+		gain[(first + 1) % speakers] += sin(t * M_PI / 2);
+	}
+};
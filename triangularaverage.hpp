@@ -15,131 +15,139 @@
  * For a full copy of the GNU General Public License see the LICENSE file.
  */
 
+#pragma once
+
+#include <limits.h>
+#include "arena.hpp"
+
+// Triangular moving average of an integer signal.
+//
+// The filter weights are 1, 2, ..., h, h, ..., 2, 1 (h = window size / 2),
+// the output is scaled by their sum h * (h + 1). It is computed with two
+// cascaded running sums, which need the input at four taps: now, h, h + 1 and
+// window size + 1 data points ago. The input is kept in a ring of one int per
+// data point, as long as the largest window plus the data points pushed ahead
+// of the reads, taken from the arena of the owner. The output is exact for
+// any input.
 class TriangularAverage
 {
 public:
-	TriangularAverage() {
-		vecData = nullptr;
-		vecSum = nullptr;
-		vecSumScaled = nullptr;
-	}
-	~TriangularAverage() {
-		delete[] vecData;
-		delete[] vecSum;
-		delete[] vecSumScaled;
+	// Arena bytes for windows up to size data points, with up to ahead data
+	// points pushed before they are read
+	static size_t bytes(int size, int ahead) {
+		return Arena::bytes<int>(size + ahead + 2);
 	}
 
-	void init(int size, int windowSize = 0) {
+	void init(int size, int ahead, Arena& arena) {
 		iSize = size;
+		iCapacity = size + ahead + 2;
+		vecData = arena.take<int>(iCapacity);
 
-		vecData = new int[iSize];
-		vecSum = new long[iSize];
-		vecSumScaled = new float[iSize];
-
-		// Calculate distances using a window size just a little bit smaller than the buffer
-		// TODO: Maybe increase buffer size for fewer overruns and better overrun detection?
-		if (windowSize) setWindowSize(windowSize);
-        else resetWindowSize();
-
-		clean();
+		resetWindowSize();
 	}
 
-    void resetWindowSize() {
-        setWindowSize(iSize * 0.95);
-    }
+	void resetWindowSize() {
+		setWindowSize(iSize * 0.95);
+	}
 
 	int getWindowSize() {
 		return iWindowSize;
 	}
 
-    void setWindowSize(int size) {
-        if (size >= iSize) size = iSize - 1;
-        if (size % 2 != 0) size--;
+	void setWindowSize(int size) {
+		if (size >= iSize) size = iSize - 1;
+		if (size % 2 != 0) size--;
 		iWindowSize = size;
-        
-		vecOffset[0] = -(size + 1);
-		vecOffset[1] = -(size / 2 + 1);
-		vecOffset[2] = vecOffset[1] + 1;
 
-        size /= 2;
-        fScalingFactor = (1.f + size) * size;
+		vecOffset[0] = 0;
+		vecOffset[1] = -(size / 2);
+		vecOffset[2] = vecOffset[1] - 1;
+		vecOffset[3] = -(size + 1);
 
-		clean();
-    }
+		size /= 2;
+		fScalingFactor = (1.f + size) * size;
 
-	void clean() {
-		for (int i = 0; i < iSize; i++) {
-			vecData[i] = 0;
-			vecSum[i] = 0;
-			vecSumScaled[i] = 0.0;
-		}
+		clean();
+	}
 
+	// Reset to an input that has been value forever
+	void clean(int value = 0) {
 		iStep = 0;
+		lSum = (long) value * scale();
+		iBase = iLast = value;
+		lLastChange = LONG_MIN / 2;
 
 		ptrFill = 0;
 		ptrRead = 0;
+		for (int t = 0; t < 4; t++) {
+			index[t] = vecOffset[t] % iCapacity;
+			if (index[t] < 0) index[t] += iCapacity;
+		}
 	}
 
-    void reduce(int &position) {
-        while (position < 0) position += iSize;
-        while (position >= iSize) position -= iSize;
-    }
-
-    int getRelPos(int position = 0) {
-        return getAbsPos(position + ptrFill);
-    }
-
-    int getAbsPos(int position) {
-        reduce(position);
-        return position;
-    }
-
 	// Push data points into the average filter
 	void pushData(int value, int length = 1) {
 		if (length < 1) return;
 
-        int target = ptrFill + length;
-        for (; ptrFill < target; ptrFill++) {
-            iStep += (value
-                + vecData[getRelPos(vecOffset[0])]
-                - vecData[getRelPos(vecOffset[1])]
-                - vecData[getRelPos(vecOffset[2])]);
-            vecData[getRelPos()] = value;
-            // TODO
-            vecSum[getRelPos()] = vecSum[getRelPos(-1)] + iStep;
-            vecSumScaled[getRelPos()] = vecSum[getRelPos()] / fScalingFactor;
-        }
-
-        ptrFill %= iSize;
+		if (value != iLast) {
+			iLast = value;
+			lLastChange = ptrFill;
+		}
+		// Longer pushes only leave their end in the ring
+		int n = (length < iCapacity) ? length : iCapacity;
+		int index = (ptrFill + length - n) % iCapacity;
+		for (int i = 0; i < n; i++) {
+			vecData[index] = value;
+			if (++index == iCapacity) index = 0;
+		}
+		ptrFill += length;
 	}
 
 	// Get data point out of the filter and increment ptrRead
 	float popData() {
-		if (ptrRead == iSize) ptrRead = 0;
-		return vecSumScaled[ptrRead++];
+		iStep += (readTap(0) + readTap(3) - readTap(1) - readTap(2));
+		lSum += iStep;
+		ptrRead++;
+		for (int t = 0; t < 4; t++) {
+			if (++index[t] == iCapacity) index[t] = 0;
+		}
+
+		return lSum / fScalingFactor;
 	}
 
-	// Read out data without incrementing ptrRead
-	float readData(int offset = 0) {
-		int position = ptrRead + offset;
-        reduce(position);
+	// All taps of the last data point read value, so the output is value
+	// until the input changes
+	bool settled(int value) const {
+		return iLast == value && ptrRead - 1 + vecOffset[3] >= lLastChange;
+	}
 
-		return vecSumScaled[position];
+private:
+	// Input at tap t of the current data point: before the first push the
+	// input of clean(), after the last one the last pushed value
+	int readTap(int t) const {
+		long position = ptrRead + vecOffset[t];
+		if (position < 0) return iBase;
+		if (position >= ptrFill) return iLast;
+		return vecData[index[t]];
 	}
 
-	void resetPointers() {
-		ptrFill = 0;
-		ptrRead = 0;
+	long scale() const {
+		long half = iWindowSize / 2;
+		return half * (half + 1);
 	}
 
-private:
-	int iSize, iWindowSize;
+	int iSize, iCapacity, iWindowSize;
 	int iStep;
+	long lSum;
 	float fScalingFactor;
-	int *vecData;
-	long *vecSum;
-	float *vecSumScaled;
-	int vecOffset[3];
+	int vecOffset[4];
+	// Ring index of every tap
+	int index[4];
+
+	// Input before the first push, the last pushed one and where it started
+	int iBase, iLast;
+	long lLastChange;
+	int* vecData = nullptr;
 
-	int ptrFill, ptrRead;
-};
\ No newline at end of file
+	long ptrFill, ptrRead;
+};
@@ -0,0 +1,233 @@
+/*
+ * Brain's Pan, a LV2 ensemble panner
+ * Copyright (c) 2020 Christian Masser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hint to the core that the thread is spinning
+static inline void spinPause() {
+#if defined(__SSE2__)
+	_mm_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+// Pool of worker threads that help the audio thread with one block.
+// The threads are spawned and pinned to a core in start(), outside of the
+// audio thread. The workers of all pools share the cores the process may
+// run on, at most one is pinned to each. run() hands out the groups of a block through atomic
+// counters: it neither allocates nor locks. The calling thread works on
+// the groups as well, so a block is finished even if a worker is late.
+class WorkerPool {
+public:
+	typedef void (*Job)(void* context, int group);
+
+	~WorkerPool() {
+		stop();
+	}
+
+	// Spawn count worker threads, which will call job(context, group)
+	void start(int count, Job job, void* context) {
+		this->job = job;
+		this->context = context;
+		quit = false;
+
+		for (int i = 0; i < count; i++) {
+			threads.emplace_back(&WorkerPool::work, this);
+			int core = claimCore();
+			cores.push_back(core);
+#ifdef __linux__
+			if (core >= 0) {
+				cpu_set_t cpus;
+				CPU_ZERO(&cpus);
+				CPU_SET(core, &cpus);
+				pthread_setaffinity_np(threads.back().native_handle(), sizeof(cpus), &cpus);
+			}
+#endif
+		}
+	}
+
+	void stop() {
+		if (threads.empty()) return;
+		quit = true;
+		generation++;
+		wake();
+		for (std::thread& thread : threads) thread.join();
+		threads.clear();
+		for (int core : cores) releaseCore(core);
+		cores.clear();
+	}
+
+	// Number of cores the process may run on
+	static int available() {
+#ifdef __linux__
+		cpu_set_t cpus;
+		if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0 && CPU_COUNT(&cpus) > 0) return CPU_COUNT(&cpus);
+#endif
+		int cores = std::thread::hardware_concurrency();
+		return (cores > 0) ? cores : 1;
+	}
+
+	int size() const {
+		return threads.size();
+	}
+
+	// Run job(context, g) for all g in [0, count[ and return when all are done
+	void run(int count) {
+		if (!scheduled) adoptScheduling();
+
+		// Published by the increment of generation. A worker still in process()
+		// from the last block may already see the new count, it then helps.
+		groups.store(count);
+		done.store(0);
+		nextGroup.store(0);
+		generation++;
+		if (sleeping > 0) wake();
+
+		process();
+		while (done.load(std::memory_order_acquire) < count) spinPause();
+	}
+
+private:
+	// Claim and run groups until there are none left
+	void process() {
+		int g;
+		while ((g = nextGroup.fetch_add(1)) < groups.load()) {
+			job(context, g);
+			done.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	void work() {
+		uint32_t seen = generation;
+		while (true) {
+			// Spin for a moment, as the next block is usually due soon, then sleep
+			for (int i = 0; i < SPIN && generation == seen; i++) spinPause();
+			while (generation == seen) {
+				sleeping++;
+				wait(seen);
+				sleeping--;
+			}
+			seen = generation;
+			if (quit) return;
+			process();
+		}
+	}
+
+	void wait(uint32_t seen) {
+#ifdef __linux__
+		syscall(SYS_futex, (uint32_t*) &generation, FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0);
+#else
+		if (generation == seen) sched_yield();
+#endif
+	}
+
+	void wake() {
+#ifdef __linux__
+		syscall(SYS_futex, (uint32_t*) &generation, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+	}
+
+	// Reserve a core for a worker: one the process may run on but the first,
+	// which is left to the audio thread, and no other worker is pinned to.
+	// Returns -1 if there is none, the worker then runs unpinned.
+	static int claimCore() {
+#ifdef __linux__
+		std::lock_guard<std::mutex> guard(pinning());
+		cpu_set_t allowed;
+		if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+		cpu_set_t& taken = pinned();
+		bool first = true;
+		for (int core = 0; core < CPU_SETSIZE; core++) {
+			if (!CPU_ISSET(core, &allowed)) continue;
+			if (first) {
+				first = false;
+				continue;
+			}
+			if (!CPU_ISSET(core, &taken)) {
+				CPU_SET(core, &taken);
+				return core;
+			}
+		}
+#endif
+		return -1;
+	}
+
+	static void releaseCore(int core) {
+#ifdef __linux__
+		if (core < 0) return;
+		std::lock_guard<std::mutex> guard(pinning());
+		CPU_CLR(core, &pinned());
+#endif
+	}
+
+#ifdef __linux__
+	// The cores workers of all pools are pinned to, guarded by pinning()
+	static cpu_set_t& pinned() {
+		static cpu_set_t cpus;
+		return cpus;
+	}
+
+	static std::mutex& pinning() {
+		static std::mutex mutex;
+		return mutex;
+	}
+#endif
+
+	// Give the workers the real-time priority of the audio thread, once
+	void adoptScheduling() {
+		scheduled = true;
+		int policy;
+		sched_param param;
+		if (pthread_getschedparam(pthread_self(), &policy, &param) != 0) return;
+		if (policy != SCHED_FIFO && policy != SCHED_RR) return;
+		for (std::thread& thread : threads) {
+			pthread_setschedparam(thread.native_handle(), policy, &param);
+		}
+	}
+
+	static const int SPIN = 20000;
+
+	Job job = nullptr;
+	void* context = nullptr;
+	std::vector<std::thread> threads;
+	// Core of each thread, -1 if it is not pinned
+	std::vector<int> cores;
+	bool scheduled = false;
+
+	std::atomic<uint32_t> generation { 0 };
+	std::atomic<int> sleeping { 0 };
+	std::atomic<int> nextGroup { 0 };
+	std::atomic<int> done { 0 };
+	std::atomic<bool> quit { false };
+	std::atomic<int> groups { 0 };
+};